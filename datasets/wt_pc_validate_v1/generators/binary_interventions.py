@@ -54,6 +54,7 @@ for counter, row in configs.iterrows():
     filename = f"{OUTPUT_DIR}/{PROTOCOL_NAME}"
     with open(filename, "w") as f:
         print("# Setup", file=f)
+        print("CFG,pressure-control", file=f)
         # Set all other manipulable variables to the desired value
         manipulable_variables = configs["from"]  # List of manipulable variables
         for var in manipulable_variables:
@@ -61,7 +61,8 @@ for hatch in [0]:
     print(f"  {protocol_name}")
     filename = f"{OUTPUT_DIR}/{protocol_name}"
     with open(filename, "w") as f:
-        # Set hatch and other exogenous variables
+        # Select the configuration, set hatch and other exogenous variables
+        print("CFG,pressure-control", file=f)
         print(f"SET,hatch,{hatch}", file=f)
         for e, zero in exogenous_zeros.items():
             print(f"SET,{e},{zero}", file=f)
@@ -32,20 +32,25 @@
 
 /**
  * Writes data over i2c
+ *
+ * @return the status of Wire.endTransmission(), i.e., 0 if successful
  */
-void Si115X::write_data(uint8_t addr, uint8_t *data, size_t len){
+uint8_t Si115X::write_data(uint8_t addr, uint8_t *data, size_t len){
   Wire.beginTransmission(addr);
   Wire.write(data, len);
-  Wire.endTransmission();
+  return Wire.endTransmission();
 }
 
 /**
  * Reads data from a register over i2c
+ *
+ * @return the register value, -1 if the transaction failed
  */
 int Si115X::read_register(uint8_t addr, uint8_t reg, int bytesOfData){
   int val = -1;
   
-  Si115X::write_data(addr, &reg, sizeof(reg));
+  if (Si115X::write_data(addr, &reg, sizeof(reg)) != 0)
+    return val;
   Wire.requestFrom(addr, bytesOfData);
   
   if(Wire.available())
@@ -116,14 +121,17 @@ int Si115X::param_query(uint8_t loc){
  *   - (2) to 0x1
  *   - (3) to 0x2
  *   - (4) to 0x3
- * And 17 after reading RESPONSE0 more than MAX_RETRIES without seeing a counter increment.
+ * And 17 after reading RESPONSE0 more than MAX_RETRIES without seeing a counter increment,
+ * or 18 if an I2C transaction failed (e.g., timed out).
  */
 
 #define MAX_RETRIES 10000
 
 int Si115X::send_command(uint8_t code, bool force){
   // Read state of RESPONSE0 before executing the command
-  uint8_t initial_read = Si115X::read_register(Si115X::DEVICE_ADDRESS, Si115X::RESPONSE_0, 1);
+  int initial_read = Si115X::read_register(Si115X::DEVICE_ADDRESS, Si115X::RESPONSE_0, 1);
+  if (initial_read < 0)
+    return 18;
   int initial_cmd_ctr = initial_read & Si115X::CMD_CTR;
   // If RESPONSE0 contained an error, return it
   if ((initial_read & Si115X::CMD_ERR) && !force)
@@ -132,12 +140,15 @@ int Si115X::send_command(uint8_t code, bool force){
   uint8_t packet[2];
   packet[0] = Si115X::COMMAND;
   packet[1] = code;    
-  Si115X::write_data(Si115X::DEVICE_ADDRESS, packet, sizeof(packet));
+  if (Si115X::write_data(Si115X::DEVICE_ADDRESS, packet, sizeof(packet)) != 0)
+    return 18;
   // Read RESPONSE0 until counter increments or an error is communicated, or maximum number of retries is reached
-  uint8_t response;
+  int response;
   int cmd_ctr;
   for(int i=0; i < MAX_RETRIES; i++) {
     response = Si115X::read_register(Si115X::DEVICE_ADDRESS, Si115X::RESPONSE_0, 1);
+    if (response < 0)
+      return 18;
     cmd_ctr = response & Si115X::CMD_CTR;
     // RESPONSE0 contains an error
     if (response & Si115X::CMD_ERR)
@@ -150,6 +161,18 @@ int Si115X::send_command(uint8_t code, bool force){
   return 17;
 }
 
+/**
+ * Send RESET_CMD_CTR, which clears CMD_ERR and the command counter in
+ * RESPONSE0. This is written directly instead of through
+ * send_command, as the counter does not increment after this command.
+ */
+void Si115X::reset_cmd_ctr(){
+  uint8_t packet[2];
+  packet[0] = Si115X::COMMAND;
+  packet[1] = Si115X::RESET_CMD_CTR;
+  Si115X::write_data(Si115X::DEVICE_ADDRESS, packet, sizeof(packet));
+}
+
 
 // bool Si115X::Begin(void){
 //   Wire.begin();
@@ -184,6 +207,8 @@ int Si115X::send_command(uint8_t code, bool force){
  */
 LightReading Si115X::read_output() {
   LightReading result;
+  result.ir_saturated = false;
+  result.vis_saturated = false;
   int data[4];
   data[0] = Si115X::read_register(Si115X::DEVICE_ADDRESS, Si115X::HOSTOUT_0, 1);
   data[1] = Si115X::read_register(Si115X::DEVICE_ADDRESS, Si115X::HOSTOUT_1, 1);
@@ -36,6 +36,10 @@ struct LightReading {
   float ir;
   float vis;
   int ok;
+  bool ir_saturated; // ADC saturation was reported for this channel
+  bool vis_saturated;
+  byte ir_gain; // ADCSENS gains used for this reading
+  byte vis_gain;
 };
 
 class Si115X
@@ -170,11 +174,12 @@ public:
   } ParameterAddress;
 		
   // Si115X();
-  void write_data(uint8_t addr, uint8_t *data, size_t len);
+  uint8_t write_data(uint8_t addr, uint8_t *data, size_t len);
   int read_register(uint8_t addr, uint8_t reg, int bytesOfData);
   void param_set(uint8_t loc, uint8_t val);
   int param_query(uint8_t loc);
   int send_command(uint8_t code, bool force);
+  void reset_cmd_ctr(void);
   // bool Begin(void); unused
   uint8_t ReadByte(uint8_t Reg);
   LightReading read_output(void);
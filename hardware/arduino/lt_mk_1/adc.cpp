@@ -0,0 +1,230 @@
+/* ; -*- mode: C;-*-
+
+   MIT License
+
+   Copyright (c) 2023 Juan L. Gamella
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include "adc.h"
+
+// A conversion takes 13 ADC clock cycles; with the 128 prescaler set
+// by the Arduino core, that is 104 microseconds
+#define ADC_CONVERSION_US 104
+
+struct AdcChannel {
+  uint8_t pin;
+  uint8_t reference;
+  // Last conversions, the latest at ring[(next - 1) % ADC_RING]
+  volatile int ring[ADC_RING];
+  volatile uint8_t next;
+  volatile uint8_t count; // Valid conversions in the ring
+  // Watch, see adc_watch
+  int lower;
+  int upper;
+  void (* callback)(int channel, int value);
+};
+
+AdcChannel adc_channels[ADC_CHANNELS];
+volatile int no_adc_channels = 0;
+volatile int adc_converting = 0; // Channel being converted
+volatile uint8_t adc_reference = 0xFF; // Selected in the ADC (none yet)
+volatile unsigned int adc_settle = 0; // Conversions left to discard
+volatile uint8_t adc_passes = 0; // Over the channels with the selected reference
+#define ADC_UNLOCKED 0xFF
+volatile uint8_t adc_locked = ADC_UNLOCKED; // Only reference converted, see adc_lock
+
+/* Selects the channel's input and reference, and starts converting it */
+void adc_convert(int channel) {
+  AdcChannel * c = &adc_channels[channel];
+  uint8_t input = c->pin - A0;
+  if (c->reference != adc_reference) {
+    adc_reference = c->reference;
+    adc_settle = ADC_SETTLE_US / ADC_CONVERSION_US + 1;
+  }
+  ADCSRB = (ADCSRB & ~_BV(MUX5)) | ((input & 0x08) ? _BV(MUX5) : 0);
+  ADMUX = (adc_reference << 6) | (input & 0x07);
+  ADCSRA |= _BV(ADSC);
+}
+
+/* Channels are converted in groups that share a reference, so the
+   reference only settles once per group: each group is gone over
+   ADC_RING times, which refills the rings of its channels, before
+   moving on to the group with the next reference. With a single
+   reference, the reference never changes. While the engine is locked
+   to a reference, only its group is converted. Returns the channel to
+   convert after the given one */
+int adc_next(int channel) {
+  // Locked to another reference: move to its group right away
+  if (adc_locked != ADC_UNLOCKED && adc_locked != adc_reference) {
+    for (int next = 0; next < no_adc_channels; next++)
+      if (adc_channels[next].reference == adc_locked)
+        return next;
+  }
+  // Next channel in the group, unless the passes are done
+  for (int i = 1; i <= no_adc_channels; i++) {
+    int next = (channel + i) % no_adc_channels;
+    if (adc_channels[next].reference != adc_reference)
+      continue;
+    if (next > channel)
+      return next;
+    // Back at the start of the group
+    if (adc_locked == adc_reference || ++adc_passes < ADC_RING)
+      return next;
+    adc_passes = 0;
+    break;
+  }
+  // First channel of the group with the next higher reference, or
+  // else with the lowest one (the same group if there is no other)
+  int first = -1;
+  for (int next = 0; next < no_adc_channels; next++) {
+    uint8_t reference = adc_channels[next].reference;
+    if (reference > adc_reference && (first < 0 || reference < adc_channels[first].reference))
+      first = next;
+  }
+  if (first >= 0)
+    return first;
+  for (int next = 0; next < no_adc_channels; next++)
+    if (first < 0 || adc_channels[next].reference < adc_channels[first].reference)
+      first = next;
+  return first;
+}
+
+ISR(ADC_vect) {
+  int value = ADC;
+  AdcChannel * c = &adc_channels[adc_converting];
+  if (adc_settle > 0) {
+    // The reference is still settling: convert the same channel again
+    adc_settle--;
+  } else {
+    c->ring[c->next] = value;
+    c->next = (c->next + 1) % ADC_RING;
+    if (c->count < ADC_RING)
+      c->count++;
+    if (c->callback != NULL && (value < c->lower || value > c->upper))
+      c->callback(adc_converting, value);
+    adc_converting = adc_next(adc_converting);
+  }
+  adc_convert(adc_converting);
+}
+
+/* Registers an analog pin (A0 to A15) to be converted with the given
+   reference (DEFAULT, INTERNAL1V1 or INTERNAL2V56); returns the
+   channel. Channels can also be added while the engine runs */
+int adc_add_channel(uint8_t pin, uint8_t reference) {
+  AdcChannel * c = &adc_channels[no_adc_channels];
+  c->pin = pin;
+  c->reference = reference;
+  c->next = 0;
+  c->count = 0;
+  c->callback = NULL;
+  noInterrupts();
+  int channel = no_adc_channels++;
+  interrupts();
+  return channel;
+}
+
+/* Changes the reference of a channel; its conversions with the old
+   reference are dropped */
+void adc_set_reference(int channel, uint8_t reference) {
+  noInterrupts();
+  adc_channels[channel].reference = reference;
+  adc_channels[channel].count = 0;
+  interrupts();
+}
+
+/* Calls callback(channel, value) from the ADC interrupt whenever a
+   conversion of the channel is below lower or above upper */
+void adc_watch(int channel, int lower, int upper, void (*callback)(int channel, int value)) {
+  noInterrupts();
+  adc_channels[channel].lower = lower;
+  adc_channels[channel].upper = upper;
+  adc_channels[channel].callback = callback;
+  interrupts();
+}
+
+/* Converts only the channels with the given reference until
+   adc_unlock. If another group is being converted, the switch happens
+   after the current conversion, and the reference then settles (see
+   ADC_SETTLE_US). Can be called from interrupts */
+void adc_lock(uint8_t reference) {
+  adc_locked = reference;
+}
+
+/* Goes back to converting all the channels */
+void adc_unlock() {
+  adc_locked = ADC_UNLOCKED;
+}
+
+/* Enables the ADC interrupt and starts converting the first channel */
+void adc_start() {
+  if (no_adc_channels == 0)
+    return;
+  ADCSRA |= _BV(ADEN) | _BV(ADIE);
+  adc_converting = 0;
+  adc_convert(0);
+}
+
+/* Drops the conversions of the channel, e.g. when its input has just
+   changed; the next readings start at most one conversion (104 us)
+   before this call */
+void adc_discard(int channel) {
+  noInterrupts();
+  adc_channels[channel].count = 0;
+  interrupts();
+}
+
+/* Drops the conversions of all channels, e.g. after a change of the
+   actuators that may affect any of them */
+void adc_discard_all() {
+  noInterrupts();
+  for (int channel = 0; channel < no_adc_channels; channel++)
+    adc_channels[channel].count = 0;
+  interrupts();
+}
+
+/* Waits until the channel has the given number of conversions */
+void adc_wait(int channel, int samples) {
+  while (adc_channels[channel].count < samples);
+}
+
+/* Latest conversion of the channel */
+int adc_latest(int channel) {
+  AdcChannel * c = &adc_channels[channel];
+  adc_wait(channel, 1);
+  noInterrupts();
+  int value = c->ring[(c->next + ADC_RING - 1) % ADC_RING];
+  interrupts();
+  return value;
+}
+
+/* Average of the latest conversions of the channel (at most ADC_RING) */
+float adc_average(int channel, int samples) {
+  AdcChannel * c = &adc_channels[channel];
+  samples = min(samples, ADC_RING);
+  adc_wait(channel, samples);
+  long sum = 0;
+  noInterrupts();
+  for (int i = 1; i <= samples; i++)
+    sum += c->ring[(c->next + ADC_RING - i) % ADC_RING];
+  interrupts();
+  return (float)sum / samples;
+}
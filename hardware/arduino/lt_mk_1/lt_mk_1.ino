@@ -83,8 +83,15 @@
 #define TEETH_SMALL 25
 #define TEETH_LARGE 50
 
-// Delay after each motor step (in ms)
-#define MOTOR_DELAY 400
+// Motion profile of the polarizer motors (in steps/s and steps/s^2),
+// see compute_ramp in utils.cpp
+#define MOTOR_START_SPEED 1250 // The motors can start and stop at this speed without ramping
+#define MOTOR_MAX_SPEED 3000
+#define MOTOR_ACCELERATION 60000
+
+// Slack in the cog train, in motor steps; the polarizers always
+// approach their final angle turning forward, to take it up
+#define MOTOR_BACKLASH 8
 
 /* ------------------------------------------------------------------- */
 /* LIBRARIES */
@@ -92,12 +99,16 @@
 #include <Wire.h> // For I2C communication
 
 #include <MCP4151.h> // For digital potentiometers / rheostats
-#include <TCA9548A.h> // For I2C Multiplexer/Hub
 #include <FastLED.h> // For LED matrix
+#include <TimerThree.h> // For the polarizer stepper motors
+#include <EEPROM.h> // To skip homing the polarizers after a reset
+#include <TimerOne.h> // For the frames of animated light-source patterns
 
 #include "utils.h" // Utility functions
 #include "serial_comms.h" // Protocol to communicate loss-less via serial
 #include "Si115X.h" // Modified sunlight sensor v2.0
+#include "multiplexer.h" // I2C Multiplexer/Hub
+#include "adc.h" // Free-running acquisition of the analog inputs
 
 /* ------------------------------------------------------------------- */
 /* HARDWARE: low-level code to control actuators & sensors */
@@ -106,119 +117,415 @@
 /* Stepper motors */
  
 struct Motor {
-  int position;
+  // Motion state, updated by the stepping interrupt (see step_motor)
+  volatile int position;
+  volatile int target;
+  volatile int goal; // Where the move ends, after taking up the backlash
+  volatile int dir;
+  volatile bool pulse; // Step pin is high
+  volatile bool moving;
+  volatile uint8_t level; // Current speed level in the ramp
+  volatile unsigned int wait; // Microseconds to the next edge of the step pin
   int pin_step;
   int pin_dir;
   int pin_sel_0;
   int pin_sel_1;
   int pin_sel_2;
   int pin_poti;
+  int limit_channel; // ADC channel watching the angle sensor, see setup_motor
   int zero;
+  int backlash; // in steps, see set_angle
+  // Motion profile, see compute_ramp
+  float start_speed;
+  float max_speed;
+  float acceleration;
+  unsigned int ramp[RAMP_SIZE];
+  uint8_t ramp_length;
 };
 
 Motor motor_1 = {.position=0,
+                 .target=0,
+                 .goal=0,
+                 .dir=1,
+                 .pulse=false,
+                 .moving=false,
+                 .level=0,
+                 .wait=0,
                  .pin_step=PIN_MOTOR_1_STEP,
                  .pin_dir=PIN_MOTOR_1_DIR,
                  .pin_sel_0=PIN_MOTOR_1_SEL_0,
                  .pin_sel_1=PIN_MOTOR_1_SEL_1,
                  .pin_sel_2=PIN_MOTOR_1_SEL_2,
                  .pin_poti=PIN_POTI_A,
-                 .zero=507};
+                 .zero=507,
+                 .backlash=MOTOR_BACKLASH,
+                 .start_speed=MOTOR_START_SPEED,
+                 .max_speed=MOTOR_MAX_SPEED,
+                 .acceleration=MOTOR_ACCELERATION};
 Motor motor_2 = {.position=0,
+                 .target=0,
+                 .goal=0,
+                 .dir=1,
+                 .pulse=false,
+                 .moving=false,
+                 .level=0,
+                 .wait=0,
                  .pin_step=PIN_MOTOR_2_STEP,
                  .pin_dir=PIN_MOTOR_2_DIR,
                  .pin_sel_0=PIN_MOTOR_2_SEL_0,
                  .pin_sel_1=PIN_MOTOR_2_SEL_1,
                  .pin_sel_2=PIN_MOTOR_2_SEL_2,
                  .pin_poti=PIN_POTI_B,
-                 .zero=512};
+                 .zero=512,
+                 .backlash=MOTOR_BACKLASH,
+                 .start_speed=MOTOR_START_SPEED,
+                 .max_speed=MOTOR_MAX_SPEED,
+                 .acceleration=MOTOR_ACCELERATION};
+
 
+// These are limits on the angle-sensor readings; to prevent breaking
+// the sensor, the motors cannot turn past this reading. They are
+// checked on every conversion of the sensor, which during a move is
+// at most a few conversions (104 us each) apart, see limit_crossed
+#define LOWER_LIMIT 10
+#define UPPER_LIMIT 1010
+
+void setup_motor(Motor * motor) {
+  pinMode((*motor).pin_poti, INPUT);
+  pinMode((*motor).pin_step,OUTPUT);
+  pinMode((*motor).pin_dir,OUTPUT);
+  pinMode((*motor).pin_sel_0,OUTPUT);
+  pinMode((*motor).pin_sel_1,OUTPUT);
+  pinMode((*motor).pin_sel_2,OUTPUT);
+  digitalWrite((*motor).pin_sel_0,STEP_SEL_0);
+  digitalWrite((*motor).pin_sel_1,STEP_SEL_1);
+  digitalWrite((*motor).pin_sel_2,STEP_SEL_2);
+  digitalWrite((*motor).pin_dir,HIGH);
+  (*motor).limit_channel = adc_add_channel((*motor).pin_poti, DEFAULT);
+  adc_watch((*motor).limit_channel, LOWER_LIMIT, UPPER_LIMIT, limit_crossed);
+  (*motor).ramp_length = compute_ramp((*motor).ramp, (*motor).start_speed, (*motor).max_speed, (*motor).acceleration);
+}
+
+// Both motors are stepped from the Timer3 interrupt. After each
+// interrupt its period is set to the time to the next edge of either
+// step pin (see step_motors), so it only fires when there is an edge
+// to make. Edges of the two motors less than MOTOR_MIN_TICK apart are
+// made in the same interrupt, the later one up to that much early.
+#define MOTOR_MIN_TICK 20
+
+unsigned int motor_tick; // Current period of Timer3, in microseconds
+
+void setup_motors() {
+  Timer3.initialize(MOTOR_MIN_TICK);
+  Timer3.attachInterrupt(step_motors);
+  Timer3.stop();
+}
+
+// Called from the Timer3 interrupt, tick microseconds after the last
+// call: the motor raises or lowers its step pin once half of its
+// current step period has passed, so a step takes two edges. After
+// each step the speed level for the next one is chosen; the first step
+// of a move is at the start speed. The motor only turns back or stops
+// at the start speed; a change of direction takes half a step period
+// of its own, to give the driver time to register it before the next
+// step. Once at its target, the motor continues to its goal, if they
+// differ.
+void step_motor(Motor *motor, unsigned int tick) {
+  if (!(*motor).moving)
+    return;
+  if ((*motor).wait > tick + MOTOR_MIN_TICK) {
+    (*motor).wait -= tick;
+    return;
+  }
+  // Steps left in the current direction
+  int remaining = ((*motor).target - (*motor).position) * (*motor).dir;
+  if ((*motor).pulse) {
+    digitalWrite((*motor).pin_step,LOW);
+    (*motor).pulse = false;
+    (*motor).position += (*motor).dir;
+    (*motor).level = ramp_level((*motor).level, (*motor).ramp_length, remaining - 1);
+  } else if (remaining <= 0 && (*motor).level == 0) {
+    if (remaining == 0 && (*motor).target != (*motor).goal)
+      (*motor).target = (*motor).goal;
+    else if (remaining == 0)
+      (*motor).moving = false;
+    else {
+      (*motor).dir = -(*motor).dir;
+      digitalWrite((*motor).pin_dir, (*motor).dir < 0 ? LOW : HIGH);
+    }
+  } else {
+    digitalWrite((*motor).pin_step,HIGH);
+    (*motor).pulse = true;
+  }
+  (*motor).wait = (*motor).ramp[(*motor).level] / 2;
+}
+
+void step_motors() {
+  step_motor(&motor_1, motor_tick);
+  step_motor(&motor_2, motor_tick);
+  // Time to the next edge of either motor
+  unsigned int tick = 0;
+  if (motor_1.moving)
+    tick = motor_1.wait;
+  if (motor_2.moving && (tick == 0 || motor_2.wait < tick))
+    tick = motor_2.wait;
+  if (tick == 0) {
+    Timer3.stop();
+    adc_unlock(); // See move_motor_to
+  } else if (tick != motor_tick) {
+    motor_tick = tick;
+    Timer3.setPeriod(tick);
+  }
+}
 
-void setup_motor(Motor motor) {
-  pinMode(motor.pin_poti, INPUT);
-  pinMode(motor.pin_step,OUTPUT);
-  pinMode(motor.pin_dir,OUTPUT);
-  pinMode(motor.pin_sel_0,OUTPUT);
-  pinMode(motor.pin_sel_1,OUTPUT);
-  pinMode(motor.pin_sel_2,OUTPUT);
-  digitalWrite(motor.pin_sel_0,STEP_SEL_0);
-  digitalWrite(motor.pin_sel_1,STEP_SEL_1);
-  digitalWrite(motor.pin_sel_2,STEP_SEL_2);
+// Starts moving the motor to the target and from there to the goal,
+// and returns right away; the move continues in the background, at the
+// same time as that of the other motor. A new move while the motor is
+// moving changes its target and goal.
+void move_motor_to(Motor *motor, int target, int goal) {
+  // The ADC engine only converts the angle sensors (DEFAULT reference)
+  // while a motor moves, so the limit watchdog has no gaps; the move
+  // starts once the sensor has been converted under the lock
+  if (!(*motor).moving) {
+    adc_lock(DEFAULT);
+    adc_discard((*motor).limit_channel);
+    adc_latest((*motor).limit_channel);
+  }
+  noInterrupts();
+  bool start = !motor_1.moving && !motor_2.moving;
+  (*motor).target = target;
+  (*motor).goal = goal;
+  if (!(*motor).moving) {
+    (*motor).level = 0;
+    (*motor).wait = (*motor).ramp[0] / 2;
+    // The timer is already running for the other motor, and part of
+    // its period may have passed: count the whole period on top, so
+    // the first edge is not early
+    if (!start)
+      (*motor).wait += motor_tick;
+    (*motor).moving = true;
+    adc_lock(DEFAULT); // Again, in case the other motor stopped meanwhile
+  }
+  interrupts();
+  if (start) {
+    motor_tick = (*motor).wait;
+    Timer3.setPeriod(motor_tick);
+    Timer3.start();
+  }
 }
 
+// Moves the motor by the given number of steps, directly; only for a
+// motor that has stopped
+void move_motor(Motor *motor, int steps) {
+  int goal = (*motor).goal + steps;
+  move_motor_to(motor, goal, goal);
+}
+
+// Limit watchdog: the angle sensors are converted continuously by the
+// ADC engine (see adc.h), with the DEFAULT reference, and each reading
+// past the limits calls limit_crossed from the ADC interrupt. While a
+// motor moves, the engine is locked to the DEFAULT reference (see
+// move_motor_to), so a reading is at most a few conversions old. If that
+// motor is moving, both motors are stopped right away; the error is
+// then reported from the main loop (see wait_motor and loop).
+volatile bool limit_hit = false;
+
+void limit_crossed(int channel, int value) {
+  Motor *motor = (channel == motor_1.limit_channel) ? &motor_1 : &motor_2;
+  if ((*motor).moving) {
+    motor_1.moving = false;
+    motor_2.moving = false;
+    limit_hit = true;
+  }
+}
+
+// Reports a limit crossed by the watchdog
+void check_motor_limits() {
+  if (limit_hit)
+    fail("er05");
+}
+
+// Blocks until the motor reaches its target. The camera cycle keeps
+// running meanwhile (see yield), so the shutter is released on time.
+void wait_motor(Motor *motor) {
+  while ((*motor).moving)
+    yield();
+  check_motor_limits();
+}
+
+void wait_motors() {
+  while (motor_1.moving || motor_2.moving)
+    yield();
+  check_motor_limits();
+}
+
+// Reading of the angle sensor (DEFAULT reference), averaged over the
+// given number of conversions taken after the call
+int read_poti(Motor *motor, int samples) {
+  adc_discard((*motor).limit_channel);
+  return round(adc_average((*motor).limit_channel, samples));
+}
+
+// Homing: the motor first moves in coarse steps towards the zero
+// reading of its angle sensor. Each time the reading crosses the zero
+// the step is halved, until the zero is found to within one step.
+#define HOMING_COARSE 256
+
 void reset_motor(Motor * motor) {
-  analogReference(DEFAULT);
-  int dist;
-  do {
-    dist = (*motor).zero - analogRead((*motor).pin_poti);
-    move_motor(motor, (dist > 0) ? 1 : -1);
-  } while (dist != 0);
+  int step = HOMING_COARSE;
+  int last_dir = 0;
+  int dist = (*motor).zero - read_poti(motor, 1);
+  while (dist != 0) {
+    int dir = (dist > 0) ? 1 : -1;
+    if (last_dir != 0 && dir != last_dir) {
+      if (step == 1)
+        break;
+      step /= 2;
+    }
+    move_motor(motor, dir * step);
+    wait_motor(motor);
+    last_dir = dir;
+    dist = (*motor).zero - read_poti(motor, 1);
+  }
+  noInterrupts();
   (*motor).position = 0;
-}
+  (*motor).target = 0;
+  (*motor).goal = 0;
+  interrupts();
+}
+
+// The zero readings of each unit (set with zero_1/zero_2, see
+// calibrate_motor) and the last known position of the motors are kept
+// in EEPROM. RST parks the motors and records where
+// they were left; on the next boot, if the angle sensors still agree
+// with the record, homing is skipped. The record is invalidated after
+// every boot, so the motors are homed again unless the board was
+// reset through RST.
+#define HOMING_ADDR 0
+#define HOMING_VERSION 0x4c01 // Change to discard the stored records
+#define HOMING_TOLERANCE 2 // Sensor counts
+
+struct HomingRecord {
+  uint16_t version;
+  int zero[2]; // Angle-sensor readings at angle 0, per unit
+  bool parked; // The motors were stopped at the recorded position
+  int position[2]; // in steps
+  int reading[2]; // Angle-sensor readings at that position
+};
 
-// These are limits on the angle-sensor readings; to prevent breaking
-// the sensor, the motors cannot turn past this reading
-#define LOWER_LIMIT 10
-#define UPPER_LIMIT 1010
+HomingRecord homing;
+
+
+// Loads the record, writing a new one with the default zero readings
+// if there is none
+void load_homing_record() {
+  EEPROM.get(HOMING_ADDR, homing);
+  if (homing.version != HOMING_VERSION) {
+    homing.version = HOMING_VERSION;
+    homing.zero[0] = motor_1.zero;
+    homing.zero[1] = motor_2.zero;
+    homing.parked = false;
+    EEPROM.put(HOMING_ADDR, homing);
+  }
+  motor_1.zero = homing.zero[0];
+  motor_2.zero = homing.zero[1];
+}
+
+void home_motors() {
+  load_homing_record();
+  bool verified = homing.parked
+    && abs(read_poti(&motor_1, 4) - homing.reading[0]) <= HOMING_TOLERANCE
+    && abs(read_poti(&motor_2, 4) - homing.reading[1]) <= HOMING_TOLERANCE;
+  if (verified) {
+    noInterrupts();
+    motor_1.position = motor_1.target = motor_1.goal = homing.position[0];
+    motor_2.position = motor_2.target = motor_2.goal = homing.position[1];
+    interrupts();
+  } else {
+    reset_motor(&motor_1);
+    reset_motor(&motor_2);
+  }
+  homing.parked = false;
+  EEPROM.put(HOMING_ADDR, homing);
+}
+
+// Stores a new zero reading for the motor of the given unit (0 or 1)
+// and homes the motor to it
+void calibrate_motor(Motor * motor, int unit, int zero) {
+  wait_motor(motor);
+  (*motor).zero = zero;
+  homing.zero[unit] = zero;
+  EEPROM.put(HOMING_ADDR, homing);
+  reset_motor(motor);
+}
+
+// Records the position of the motors; they must have stopped
+void park_motors() {
+  homing.parked = true;
+  homing.position[0] = motor_1.position;
+  homing.position[1] = motor_2.position;
+  homing.reading[0] = read_poti(&motor_1, 4);
+  homing.reading[1] = read_poti(&motor_2, 4);
+  EEPROM.put(HOMING_ADDR, homing);
+}
+
+// Higher level: calculates the position for the target angle and
+// moves the motor there. If the motor would reach it turning backward,
+// it first turns past it by the backlash and then forward, so the cogs
+// always mesh on the same side at the end of a move. Turning past is
+// limited to -180 degrees, so angles within the backlash of -180 are
+// approached forward only part of the way.
+#define HALF_TURN (MOTOR_STEPS * TEETH_LARGE / TEETH_SMALL / 2) // 180 degrees of the polarizer, in steps
 
-void move_motor(Motor *motor, int steps) {
-  analogReference(DEFAULT);
-  // Set motor direction based on sign of steps
-  int dir = 0;
-  if (steps < 0) {
-    dir = -1;
-    digitalWrite((*motor).pin_dir,LOW);
-  } else {
-    dir = 1;
-    digitalWrite((*motor).pin_dir,HIGH);
-  }
-  // Move motor
-  for(int i = 0; i < dir*steps; i++) {
-    int pos = analogRead((*motor).pin_poti);
-    if (pos < LOWER_LIMIT || pos > UPPER_LIMIT)
-      fail("er05");
-    digitalWrite((*motor).pin_step,HIGH) ; 
-    delayMicroseconds(MOTOR_DELAY);
-    digitalWrite((*motor).pin_step,LOW); 
-    delayMicroseconds(MOTOR_DELAY);
-  }
-  (*motor).position = (*motor).position + steps;
-}
-
-// Higher level: takes the internal state, and calculates the
-// direction & number of steps to reach the target angle
 void set_angle(Motor *motor, float angle) {
-  float current_angle = ((float)(*motor).position / MOTOR_STEPS) * ((float)TEETH_SMALL / TEETH_LARGE) * 360.0;
-  float distance = angle - current_angle;
-  int steps = round(distance / 360.0 * TEETH_LARGE / TEETH_SMALL * MOTOR_STEPS);
-  move_motor(motor, steps);
+  int goal = round(angle / 360.0 * TEETH_LARGE / TEETH_SMALL * MOTOR_STEPS);
+  noInterrupts();
+  int position = (*motor).position;
+  interrupts();
+  int target = goal;
+  if (goal < position)
+    target = max(goal - (*motor).backlash, -HALF_TURN);
+  move_motor_to(motor, target, goal);
 }
 
-// i.e., getter function
-float read_angle(Motor motor) {
-  return ((float)(motor).position / MOTOR_STEPS) * ((float)TEETH_SMALL / TEETH_LARGE) * 360.0;
+// i.e., getter function: the current angle, also while moving
+float read_angle(Motor *motor) {
+  noInterrupts();
+  int position = (*motor).position;
+  interrupts();
+  return ((float)position / MOTOR_STEPS) * ((float)TEETH_SMALL / TEETH_LARGE) * 360.0;
 }
 
 /*----------------------------*/
 /* Light sensors */
  
 Si115X si1151; // Sunlight sensor v2.0
-TCA9548A<TwoWire> TCA; // I2C Multiplexer/Hub
 
 // Light sensor photodiode size and gain parameters
 byte ir_diodes[3];
 byte vis_diodes[3];
 byte ir_gains[3];
 byte vis_gains[3];
+// Automatic gain ranging (see read_light_sensor)
+bool ir_auto[3];
+bool vis_auto[3];
 
 // I2C switch channel map
 const uint8_t channels[3] = {TCA_CHANNEL_0, TCA_CHANNEL_1, TCA_CHANNEL_2};
 
+// Fastest bus speed tried for the light sensors (see
+// calibrate_channel_clock in multiplexer.cpp)
+#define LIGHT_SENSOR_MAX_CLOCK I2C_CLOCK_FAST
+
 void setup_light_sensor(uint8_t sensor){
-  uint8_t channel = channels[sensor];
-  TCA.openChannel(channel);
+  MuxSession session(channels[sensor]);
   start_si1151();
-  TCA.closeChannel(channel);
+  calibrate_channel_clock(channels[sensor], LIGHT_SENSOR_MAX_CLOCK, si1151_responds);
+}
+
+// Bus speed self-test: the part ID must read correctly
+bool si1151_responds() {
+  return si1151.ReadByte(Si115X::PART_ID) == 0x51;
 }
 
 // Starts the sensor and sets base configuration
@@ -231,15 +538,83 @@ void start_si1151() {
   si1151.param_set(Si115X::ADCCONFIG_1, 0b01101);
 }
 
+// Automatic gain ranging: if enabled for a channel, the gain is
+// stepped down when the ADC saturates or the count is above
+// AUTO_GAIN_HIGH, and stepped up when the count is below
+// AUTO_GAIN_LOW. Each gain step doubles the integration time (and
+// count), so AUTO_GAIN_LOW < AUTO_GAIN_HIGH / 2 leaves a band in which
+// the gain is kept (hysteresis)
+#define AUTO_GAIN_HIGH 48000
+#define AUTO_GAIN_LOW 16000
+#define MAX_GAIN 3 // LIGHT_MEASUREMENT_DURATION is fixed for this gain
+
 LightReading read_light_sensor(uint8_t sensor) {
-  uint8_t channel = channels[sensor];
-  LightReading reading;
-  TCA.openChannel(channel);
-  reading = read_si1151();
-  TCA.closeChannel(channel);
+  MuxSession session(channels[sensor]);
+  LightReading reading = read_sensor_at_gain(sensor);
+  // Readings with a saturated channel are repeated at a lower gain for
+  // that channel, until no channel saturates or its gain cannot be
+  // lowered further; the gains are then left for the next reading
+  while (reading.ok == 0 && range_gains(sensor, reading))
+    reading = read_sensor_at_gain(sensor);
+  return reading;
+}
+
+LightReading read_sensor_at_gain(uint8_t sensor) {
+  LightReading reading = read_si1151();
+  // If the I2C bus failed, recover it and try once more; if it fails
+  // again, report the error in place of the reading
+  if (reading.ok < 0) {
+    recover_bus();
+    reading = read_si1151();
+  }
+  if (reading.ok < 0) {
+    reading.ir = I2C_ERROR;
+    reading.vis = I2C_ERROR;
+  }
+  reading.ir_gain = ir_gains[sensor];
+  reading.vis_gain = vis_gains[sensor];
   return reading;
 }
 
+// Returns the gain to use after a reading with the given count
+byte next_gain(byte gain, float count, bool saturated) {
+  if ((saturated || count > AUTO_GAIN_HIGH) && gain > 0)
+    return gain - 1;
+  else if (!saturated && count < AUTO_GAIN_LOW && gain < MAX_GAIN)
+    return gain + 1;
+  else
+    return gain;
+}
+
+// Applies automatic gain ranging to the channels of the given sensor
+// (its I2C channel must be selected), each according to its own count
+// and saturation. Returns true if the gain of a saturated channel was
+// lowered, i.e., if the reading should be repeated.
+bool range_gains(uint8_t sensor, LightReading reading) {
+  // After saturation the sensor reports an error in RESPONSE0, which
+  // has to be cleared before setting parameters
+  if (reading.ir_saturated || reading.vis_saturated)
+    si1151.reset_cmd_ctr();
+  bool repeat = false;
+  if (ir_auto[sensor]) {
+    byte gain = next_gain(ir_gains[sensor], reading.ir, reading.ir_saturated);
+    if (gain != ir_gains[sensor]) {
+      ir_gains[sensor] = gain;
+      si1151.param_set(Si115X::ADCSENS_0, gain);
+      repeat |= reading.ir_saturated;
+    }
+  }
+  if (vis_auto[sensor]) {
+    byte gain = next_gain(vis_gains[sensor], reading.vis, reading.vis_saturated);
+    if (gain != vis_gains[sensor]) {
+      vis_gains[sensor] = gain;
+      si1151.param_set(Si115X::ADCSENS_1, gain);
+      repeat |= reading.vis_saturated;
+    }
+  }
+  return repeat;
+}
+
 /* Set the IR photodiode used for measurement */
 void set_ir_diode(uint8_t sensor, float value) {
   // Translate to the sensors registry (p. 42 of the datasheet)
@@ -247,13 +622,11 @@ void set_ir_diode(uint8_t sensor, float value) {
   if (value != 0 && value != 1 && value != 2) {
     fail("er03");
   } else {
-    uint8_t channel = channels[sensor];
     byte diode = byte(int(value)); // 0 - small, 1 - medium, 2 - large
     ir_diodes[sensor] = diode;
     // Set diode
-    TCA.openChannel(channel);
+    MuxSession session(channels[sensor]);
     si1151.param_set(Si115X::ADCCONFIG_0, diode);
-    TCA.closeChannel(channel);
   }
 }
 
@@ -264,14 +637,12 @@ void set_vis_diode(uint8_t sensor, float value) {
   if (value != 0 && value != 1) {
     fail("er03");
   } else {
-    uint8_t channel = channels[sensor];
     byte diode = byte(int(value));
     vis_diodes[sensor] = diode;
     byte adcmux = (diode == 0) ? 0b01011 : 0b01101; // small - large visible diodes
     // Set diode
-    TCA.openChannel(channel);
+    MuxSession session(channels[sensor]);
     si1151.param_set(Si115X::ADCCONFIG_1, adcmux);
-    TCA.closeChannel(channel);
   }
 }
 
@@ -282,13 +653,11 @@ void set_ir_gain(uint8_t sensor, float value) {
   if (value != 0 && value != 1 && value != 2 && value != 3) {
     fail("er03");
   } else {
-    uint8_t channel = channels[sensor];
     byte gain = byte(int(value));
     ir_gains[sensor] = gain;
     // Set gain
-    TCA.openChannel(channel);
+    MuxSession session(channels[sensor]);
     si1151.param_set(Si115X::ADCSENS_0, gain);
-    TCA.closeChannel(channel);
   }
 }
 
@@ -299,16 +668,30 @@ void set_vis_gain(uint8_t sensor, float value) {
   if (value != 0 && value != 1 && value != 2 && value != 3) {
     fail("er03");
   } else {
-    uint8_t channel = channels[sensor];
     byte gain = byte(int(value));
     vis_gains[sensor] = gain;
     // Set gain
-    TCA.openChannel(channel);
+    MuxSession session(channels[sensor]);
     si1151.param_set(Si115X::ADCSENS_1, gain);
-    TCA.closeChannel(channel);
   }
 }
 
+/* Enable/disable automatic gain ranging of the light sensor (IR measurements) */
+void set_ir_auto(uint8_t sensor, float value) {
+  if (value != 0 && value != 1)
+    fail("er03");
+  else
+    ir_auto[sensor] = (value != 0);
+}
+
+/* Enable/disable automatic gain ranging of the light sensor (visible measurements) */
+void set_vis_auto(uint8_t sensor, float value) {
+  if (value != 0 && value != 1)
+    fail("er03");
+  else
+    vis_auto[sensor] = (value != 0);
+}
+
 // We need a timing mechanism to ensure that reading the sensor always
 // takes the same amount of time, independently of the ADC integration
 // that is used (see above functions)
@@ -326,11 +709,23 @@ LightReading read_si1151() {
   // Ask sensor to perform a measurement and wait until it's ready
   si1151.send_command(Si115X::FORCE, true);
   int result = si1151.send_command(Si115X::FORCE, true);
-  if (result != 0 && result != 3) // 3 means there was overflow - read anyway
+  LightReading measurement;
+  if (result == 17 || result == 18) { // No response / I2C failure: measurement.ok < 0
+    measurement.ok = -1;
+    measurement.ir_saturated = false;
+    measurement.vis_saturated = false;
+  } else if (result != 0 && result != 3) { // 3 means there was overflow - read anyway
     fail("er08", String(result));
-  LightReading measurement = si1151.read_output();
-  if (measurement.ok < 0)
-    fail("er09", String(measurement.ok));
+  } else {
+    measurement = si1151.read_output(); // measurement.ok < 0 if I2C failed
+    // The sensor does not report which channel saturated: it is taken
+    // to be the one(s) with a count above AUTO_GAIN_HIGH, or both if
+    // neither is
+    bool ir_high = measurement.ir > AUTO_GAIN_HIGH;
+    bool vis_high = measurement.vis > AUTO_GAIN_HIGH;
+    measurement.ir_saturated = (result == 3) && (ir_high || !vis_high);
+    measurement.vis_saturated = (result == 3) && (vis_high || !ir_high);
+  }
   while (micros() - start < LIGHT_MEASUREMENT_DURATION) {
     true;
   }
@@ -381,19 +776,130 @@ void test_leds() {
   delay(500);
 }
 
+// Light-source patterns: each LED is set to a mix of two colors,
+// depending on its position or on the time. The LEDs are arranged in
+// a hexagon, in rows of 4, 5, 6, 7, 6, 5 and 4, numbered row by row
+#define PATTERN_UNIFORM 0 // First color only
+#define PATTERN_VERTICAL 1 // Gradient from the first (top) to the second color (bottom)
+#define PATTERN_HORIZONTAL 2 // Gradient from the first (left) to the second color (right)
+#define PATTERN_RADIAL 3 // Gradient from the first (center) to the second color (edge)
+#define PATTERN_FADE 4 // Back and forth between both colors, once per period
+#define PATTERN_FLICKER 5 // First color for half a period, then the second
+#define PATTERN_SINGLE 6 // One LED in the first color, the rest in the second
+#define NO_PATTERNS 7
+
+const uint8_t LED_ROWS[] = {4, 5, 6, 7, 6, 5, 4};
+
+bool is_animated(int pattern_type) {
+  return pattern_type == PATTERN_FADE || pattern_type == PATTERN_FLICKER;
+}
+
+// Animated patterns are redrawn at every frame; the Timer1 interrupt
+// only flags that a frame is due, and it is drawn from the main
+// program (see yield), as FastLED.show() can't run in an interrupt
+#define FRAME_PERIOD 20000 // in microseconds, i.e. 50 frames per second
+
+volatile bool frame_due = false;
+
+void frame_tick() {
+  frame_due = true;
+}
+
+void setup_frames() {
+  Timer1.initialize(FRAME_PERIOD);
+  Timer1.attachInterrupt(frame_tick);
+}
+
+// Returns the color a fraction t of the way from the first to the second
+CRGB mix_colors(CRGB first, CRGB second, float t) {
+  return CRGB(first.r + (second.r - first.r) * t,
+              first.g + (second.g - first.g) * t,
+              first.b + (second.b - first.b) * t);
+}
+
+// Draws a pattern; for animated patterns, t_phase is the fraction of
+// the period that has elapsed
+void draw_pattern(int pattern_type, CRGB first, CRGB second, float t_phase, int led) {
+  int i = 0;
+  for (int row = 0; row < 7; row++) {
+    for (int col = 0; col < LED_ROWS[row]; col++, i++) {
+      // Position relative to the center LED, in LED spacings
+      float x = col - (LED_ROWS[row] - 1) / 2.0;
+      float y = (row - 3) * 0.866;
+      float t = 0;
+      if (pattern_type == PATTERN_VERTICAL)
+        t = row / 6.0;
+      else if (pattern_type == PATTERN_HORIZONTAL)
+        t = (x + 3) / 6.0;
+      else if (pattern_type == PATTERN_RADIAL)
+        t = min(sqrt(x * x + y * y) / 3.0, 1.0);
+      else if (pattern_type == PATTERN_FADE)
+        t = t_phase < 0.5 ? 2 * t_phase : 2 - 2 * t_phase;
+      else if (pattern_type == PATTERN_FLICKER)
+        t = t_phase < 0.5 ? 0 : 1;
+      else if (pattern_type == PATTERN_SINGLE)
+        t = (i == led) ? 0 : 1;
+      leds[i] = mix_colors(first, second, t);
+    }
+  }
+  FastLED.show();
+}
+
 /*----------------------------*/
 /* Camera */
 bool camera_flag = false;
-unsigned long last_shutter = 0;
 
+// The shutter is pressed by pulling PIN_CAMERA low for LOW_DURATION
+// ms, and the camera needs CAM_DELAY ms after that before the next
+// picture. The trigger only presses the shutter and returns; the rest
+// of the cycle is carried out in the background (see update_camera),
+// so the sensors are read during the exposure
 #define LOW_DURATION 500
 #define CAM_DELAY 1000
-void take_picture() {  
-  digitalWrite(PIN_CAMERA, HIGH);
+
+typedef enum CameraState {
+                          CAMERA_IDLE,
+                          CAMERA_PRESSED,
+                          CAMERA_RECOVERING
+};
+
+CameraState camera_state = CAMERA_IDLE;
+unsigned long last_shutter = 0; // millis() when the shutter was pressed
+bool camera_shot = false; // A picture was triggered for the current observation
+unsigned long msr_start = 0; // millis() when the current MSR started measuring
+
+// Bursts: every observation of an MSR is taken burst times (shots),
+// burst_interval ms apart, each with its own picture and measurements.
+// When bracketing, an actuator is stepped through the shots, centered
+// on its value: shot i of k sets it to value + (i - (k-1)/2) * step
+#define BRACKET_NONE 0
+#define BRACKET_POL_1 1
+#define BRACKET_POL_2 2
+#define BRACKET_RED 3
+#define BRACKET_GREEN 4
+#define BRACKET_BLUE 5
+#define NO_BRACKETS 6
+
+int shot_index = 0; // Of the current observation in its burst
+
+// Advances the camera cycle; called from yield
+void update_camera() {
+  unsigned long elapsed = millis() - last_shutter;
+  if (camera_state == CAMERA_PRESSED && elapsed >= LOW_DURATION) {
+    digitalWrite(PIN_CAMERA, HIGH);
+    camera_state = CAMERA_RECOVERING;
+  } else if (camera_state == CAMERA_RECOVERING && elapsed >= LOW_DURATION + CAM_DELAY)
+    camera_state = CAMERA_IDLE;
+}
+
+// Presses the shutter, first waiting for the previous cycle to end
+void take_picture() {
+  while (camera_state != CAMERA_IDLE)
+    yield();
   digitalWrite(PIN_CAMERA, LOW);
-  delay(LOW_DURATION);
-  digitalWrite(PIN_CAMERA, HIGH);
-  delay(CAM_DELAY);
+  last_shutter = millis();
+  camera_state = CAMERA_PRESSED;
+  camera_shot = true;
 }
 
 /*----------------------------*/
@@ -460,6 +966,22 @@ uint8_t angle_1_reference = DEFAULT; // DEFAULT = 5V
 uint8_t angle_2_reference = DEFAULT;
 uint8_t current_reference = DEFAULT;
 
+// Their channels in the ADC engine (see adc.h)
+int angle_1_channel;
+int angle_2_channel;
+int current_channel;
+int v_board_channel;
+int v_reg_channel;
+
+void setup_analog() {
+  angle_1_channel = adc_add_channel(PIN_POTI_A, angle_1_reference);
+  angle_2_channel = adc_add_channel(PIN_POTI_B, angle_2_reference);
+  current_channel = adc_add_channel(PIN_LED_CURRENT, current_reference);
+  v_board_channel = adc_add_channel(PIN_V_BOARD, DEFAULT);
+  v_reg_channel = adc_add_channel(PIN_V_REGULATOR, DEFAULT);
+  adc_start();
+}
+
 /*----------------------------*/
 /* General chamber control */
 bool intervention_flag;
@@ -469,20 +991,23 @@ bool intervention_flag;
 /* Each configuration defines:
      - variables (names & exogenous or not)
      - setter functions
-     - take_measurements(...) function */
+     - take_measurements(...) function
+   All configurations share the same variables; the configuration is
+   selected at runtime with the CFG instruction (see the configuration
+   registry below) */
 
 #define NA -9999
 
 /* ---------------------------------------------------------------- */
 /* CONFIGURATION: standard / camera
-     - Toggled with the "camera" flag (can be set with the instruction SET,camera,1)
+     - camera: a picture is taken before each measurement; the camera
+       variable is not exogenous (in standard, the same can be done
+       with the instruction SET,camera,1)
 /*   - All manipulable variables are exogenous */
 
-// standard is changed to "camera" in the python control code
-#define CHAMBER_CONFIG "CHAMBER_CONFIG,standard"
 // List of variables that this board transmits through serial
-#define VARIABLES_LIST "VARIABLES_LIST,counter,flag,intervention,red,green,blue,osr_c,v_c,current,pol_1,pol_2,osr_angle_1,osr_angle_2,v_angle_1,v_angle_2,angle_1,angle_2,ir_1,vis_1,ir_2,vis_2,ir_3,vis_3,l_11,l_12,l_21,l_22,l_31,l_32,diode_ir_1,diode_vis_1,diode_ir_2,diode_vis_2,diode_ir_3,diode_vis_3,t_ir_1,t_vis_1,t_ir_2,t_vis_2,t_ir_3,t_vis_3,camera,v_board,v_reg"
-#define NO_VARIABLES 44 // Total number of variables (to initialize arrays)
+#define VARIABLES_LIST "VARIABLES_LIST,counter,flag,intervention,red,green,blue,osr_c,v_c,current,pol_1,pol_2,osr_angle_1,osr_angle_2,v_angle_1,v_angle_2,angle_1,angle_2,ir_1,vis_1,ir_2,vis_2,ir_3,vis_3,l_11,l_12,l_21,l_22,l_31,l_32,diode_ir_1,diode_vis_1,diode_ir_2,diode_vis_2,diode_ir_3,diode_vis_3,t_ir_1,t_vis_1,t_ir_2,t_vis_2,t_ir_3,t_vis_3,camera,v_board,v_reg,auto_ir_1,auto_vis_1,auto_ir_2,auto_vis_2,auto_ir_3,auto_vis_3,pattern,red_2,green_2,blue_2,period,led_idx,phase,shutter_time,burst,burst_interval,bracket,bracket_step,shot,zero_1,zero_2"
+#define NO_VARIABLES 65 // Total number of variables (to initialize arrays)
 
 #define counter 0
 #define flag 1
@@ -528,6 +1053,27 @@ bool intervention_flag;
 #define camera 41
 #define v_board 42
 #define v_reg 43
+#define auto_ir_1 44
+#define auto_vis_1 45
+#define auto_ir_2 46
+#define auto_vis_2 47
+#define auto_ir_3 48
+#define auto_vis_3 49
+#define pattern 50
+#define red_2 51
+#define green_2 52
+#define blue_2 53
+#define period 54
+#define led_idx 55
+#define phase 56
+#define shutter_time 57
+#define burst 58
+#define burst_interval 59
+#define bracket 60
+#define bracket_step 61
+#define shot 62
+#define zero_1 63
+#define zero_2 64
 
 float variables[NO_VARIABLES]; // Variable array (to store measurements)
 
@@ -577,6 +1123,27 @@ bool exogenous[NO_VARIABLES] = {
                                 , true //camera
                                 , false //v_board
                                 , false //v_reg
+                                , true //auto_ir_1
+                                , true //auto_vis_1
+                                , true //auto_ir_2
+                                , true //auto_vis_2
+                                , true //auto_ir_3
+                                , true //auto_vis_3
+                                , true //pattern
+                                , true //red_2
+                                , true //green_2
+                                , true //blue_2
+                                , true //period
+                                , true //led_idx
+                                , false //phase
+                                , false //shutter_time
+                                , true //burst
+                                , true //burst_interval
+                                , true //bracket
+                                , true //bracket_step
+                                , false //shot
+                                , true //zero_1
+                                , true //zero_2
 };
 
 // counter and intervention are always set internally and they don't
@@ -588,14 +1155,67 @@ void set_flag(float value) {
   variables[flag] = value;
 }
 
+// The LEDs are only updated at the end of a SETM, at the start of an
+// MSR and on COMMIT: FastLED.show() keeps interrupts disabled for
+// about 1 ms, so it should run once per change of color, not once per
+// channel. Animated patterns are also redrawn at every frame.
+bool leds_dirty = false;
+unsigned long pattern_start = 0; // millis() when the pattern was committed
+float drawn_phase = 0; // Phase of the frame on the LEDs (see draw_leds)
+
+// Fraction of its period an animated pattern is at (0 otherwise)
+float pattern_phase() {
+  if (!is_animated(variables[pattern]))
+    return 0;
+  unsigned long ms = variables[period];
+  return (float)((millis() - pattern_start) % ms) / ms;
+}
+
+void draw_leds() {
+  drawn_phase = pattern_phase();
+  if (variables[pattern] == PATTERN_UNIFORM)
+    set_color(variables[red], variables[green], variables[blue]);
+  else
+    draw_pattern(variables[pattern],
+                 CRGB(variables[red], variables[green], variables[blue]),
+                 CRGB(variables[red_2], variables[green_2], variables[blue_2]),
+                 drawn_phase,
+                 variables[led_idx]);
+}
+
+void commit_leds() {
+  if (leds_dirty) {
+    pattern_start = millis();
+    draw_leds();
+    leds_dirty = false;
+  }
+}
+
+bool measuring = false; // An observation is being taken (see loop)
+
+// Called by delay() and while waiting for serial input (see
+// receive_packet in serial_comms.cpp): advances the camera cycle and
+// draws the next frame of an animated pattern, unless it has
+// uncommitted changes. Frames are skipped while an observation is
+// taken or a polarizer moves: FastLED.show() would hold the pattern
+// mid-reading and delay the step interrupts.
+void yield() {
+  update_camera();
+  if (frame_due) {
+    frame_due = false;
+    if (!leds_dirty && !measuring && !motor_1.moving && !motor_2.moving && is_animated(variables[pattern]))
+      draw_leds();
+  }
+}
+
 void set_red(float value) {
   // Check value
   if (value == NA && exogenous[red]) {
     fail("er42");
   } else if (value >= 0 && value <= 255) {
     variables[red] = value;
-    // Physical effect
-    set_color(variables[red], variables[green], variables[blue]);
+    // Physical effect, at the next commit
+    leds_dirty = true;
   }
 }
 
@@ -605,8 +1225,8 @@ void set_green(float value) {
     fail("er42");
   } else if (value >= 0 && value <= 255) {
     variables[green] = value;
-    // Physical effect
-    set_color(variables[red], variables[green], variables[blue]);
+    // Physical effect, at the next commit
+    leds_dirty = true;
   } else {
     fail("er03");
   }
@@ -618,13 +1238,101 @@ void set_blue(float value) {
     fail("er42");
   } else if (value >= 0 && value <= 255) {
     variables[blue] = value;
-    // Physical effect
-    set_color(variables[red], variables[green], variables[blue]);
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_pattern(float value) {
+  // Check value
+  if (value == NA && exogenous[pattern]) {
+    fail("er42");
+  } else if (value >= 0 && value < NO_PATTERNS && value == (int)value) {
+    variables[pattern] = value;
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_red_2(float value) {
+  // Check value
+  if (value == NA && exogenous[red_2]) {
+    fail("er42");
+  } else if (value >= 0 && value <= 255) {
+    variables[red_2] = value;
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_green_2(float value) {
+  // Check value
+  if (value == NA && exogenous[green_2]) {
+    fail("er42");
+  } else if (value >= 0 && value <= 255) {
+    variables[green_2] = value;
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_blue_2(float value) {
+  // Check value
+  if (value == NA && exogenous[blue_2]) {
+    fail("er42");
+  } else if (value >= 0 && value <= 255) {
+    variables[blue_2] = value;
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+// Period of animated patterns, in milliseconds; at least two frames
+void set_period(float value) {
+  // Check value
+  if (value == NA && exogenous[period]) {
+    fail("er42");
+  } else if (value >= 2 * FRAME_PERIOD / 1000 && value <= 3600000) {
+    variables[period] = round(value);
+    // Physical effect, at the next commit
+    leds_dirty = true;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_led_idx(float value) {
+  // Check value
+  if (value == NA && exogenous[led_idx]) {
+    fail("er42");
+  } else if (value >= 0 && value < NUM_LEDS && value == (int)value) {
+    variables[led_idx] = value;
+    // Physical effect, at the next commit
+    leds_dirty = true;
   } else {
     fail("er03");
   }
 }
 
+void set_phase(float value) {
+  // Check value
+  if (value == NA && exogenous[phase]) {
+    fail("er42");
+  } else {
+    variables[phase] = value;
+  }
+}
+
 void set_osr_c(float value) {
   // Check value
   if (value == NA && exogenous[osr_c]) {
@@ -641,6 +1349,7 @@ void set_v_c(float value) {
     fail("er42");
   } else {
     set_reference_voltage(&current_reference,value);
+    adc_set_reference(current_channel, current_reference);
     variables[v_c] = value;
   }
 }
@@ -661,6 +1370,7 @@ void set_v_angle_1(float value) {
     fail("er42");
   } else {
     set_reference_voltage(&angle_1_reference,value);
+    adc_set_reference(angle_1_channel, angle_1_reference);
     variables[v_angle_1] = value;
   }
 }
@@ -681,6 +1391,7 @@ void set_v_angle_2(float value) {
     fail("er42");
   } else {
     set_reference_voltage(&angle_2_reference,value);
+    adc_set_reference(angle_2_channel, angle_2_reference);
     variables[v_angle_2] = value;
   }
 }
@@ -984,6 +1695,193 @@ void set_t_vis_3(float value) {
   }
 }
 
+void set_auto_ir_1(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_ir_1]) {
+    fail("er42");
+  } else {
+    set_ir_auto(0, value); // Physical effect - value checked in function
+    variables[auto_ir_1] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_ir_gain(0, variables[t_ir_1]);
+  }
+}
+
+void set_auto_vis_1(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_vis_1]) {
+    fail("er42");
+  } else {
+    set_vis_auto(0, value); // Physical effect - value checked in function
+    variables[auto_vis_1] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_vis_gain(0, variables[t_vis_1]);
+  }
+}
+
+void set_auto_ir_2(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_ir_2]) {
+    fail("er42");
+  } else {
+    set_ir_auto(1, value); // Physical effect - value checked in function
+    variables[auto_ir_2] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_ir_gain(1, variables[t_ir_2]);
+  }
+}
+
+void set_auto_vis_2(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_vis_2]) {
+    fail("er42");
+  } else {
+    set_vis_auto(1, value); // Physical effect - value checked in function
+    variables[auto_vis_2] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_vis_gain(1, variables[t_vis_2]);
+  }
+}
+
+void set_auto_ir_3(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_ir_3]) {
+    fail("er42");
+  } else {
+    set_ir_auto(2, value); // Physical effect - value checked in function
+    variables[auto_ir_3] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_ir_gain(2, variables[t_ir_3]);
+  }
+}
+
+void set_auto_vis_3(float value) {
+  // Check value
+  if (value == NA && exogenous[auto_vis_3]) {
+    fail("er42");
+  } else {
+    set_vis_auto(2, value); // Physical effect - value checked in function
+    variables[auto_vis_3] = value;
+    // Back to the fixed gain when auto-ranging is disabled
+    if (value == 0)
+      set_vis_gain(2, variables[t_vis_3]);
+  }
+}
+
+// millis() when the shutter was pressed for the observation
+void set_shutter_time(float value) {
+  // Check value
+  if (value == NA && exogenous[shutter_time]) {
+    fail("er42");
+  } else {
+    variables[shutter_time] = value;
+  }
+}
+
+void set_burst(float value) {
+  // Check value
+  if (value == NA && exogenous[burst]) {
+    fail("er42");
+  } else if (value >= 1 && value <= 100 && value == (int)value) {
+    variables[burst] = value;
+  } else {
+    fail("er03");
+  }
+}
+
+// The camera may take longer, see take_picture
+void set_burst_interval(float value) {
+  // Check value
+  if (value == NA && exogenous[burst_interval]) {
+    fail("er42");
+  } else if (value >= 0) {
+    variables[burst_interval] = value;
+  } else {
+    fail("er03");
+  }
+}
+
+// Actuator stepped by each kind of bracketing (see BRACKET_NONE)
+const char * bracket_names[NO_BRACKETS] = {"", "pol_1", "pol_2", "red", "green", "blue"};
+const uint8_t bracket_variables[NO_BRACKETS] = {0, pol_1, pol_2, red, green, blue};
+// and its range (see set_pol_1 and set_red)
+const float bracket_min[NO_BRACKETS] = {0, -180, -180, 0, 0, 0};
+const float bracket_max[NO_BRACKETS] = {0, 180, 180, 255, 255, 255};
+
+// Whether every shot of a burst of the given length keeps the
+// bracketed actuator within its range, stepping around base
+bool bracket_fits(int bracketed, float base, int shots) {
+  if (bracketed == BRACKET_NONE)
+    return true;
+  float spread = (shots - 1) / 2.0 * fabs(variables[bracket_step]);
+  return base - spread >= bracket_min[bracketed] && base + spread <= bracket_max[bracketed];
+}
+
+void set_bracket(float value) {
+  // Check value
+  if (value == NA && exogenous[bracket]) {
+    fail("er42");
+  } else if (value >= 0 && value < NO_BRACKETS && value == (int)value) {
+    variables[bracket] = value;
+  } else {
+    fail("er03");
+  }
+}
+
+void set_bracket_step(float value) {
+  // Check value
+  if (value == NA && exogenous[bracket_step]) {
+    fail("er42");
+  } else {
+    variables[bracket_step] = value;
+  }
+}
+
+void set_shot(float value) {
+  // Check value
+  if (value == NA && exogenous[shot]) {
+    fail("er42");
+  } else {
+    variables[shot] = value;
+  }
+}
+
+// Angle-sensor reading (DEFAULT reference) at angle 0. Setting it homes
+// the motor to the new zero, stores it for the next boots, and turns
+// the polarizer back to pol_1
+void set_zero_1(float value) {
+  // Check value
+  if (value == NA && exogenous[zero_1]) {
+    fail("er42");
+  } else if (value > LOWER_LIMIT && value < UPPER_LIMIT && value == (int)value) {
+    variables[zero_1] = value;
+    // Physical effect
+    calibrate_motor(&motor_1, 0, value);
+    set_angle(&motor_1, variables[pol_1]);
+  } else {
+    fail("er03");
+  }
+}
+
+void set_zero_2(float value) {
+  // Check value
+  if (value == NA && exogenous[zero_2]) {
+    fail("er42");
+  } else if (value > LOWER_LIMIT && value < UPPER_LIMIT && value == (int)value) {
+    variables[zero_2] = value;
+    // Physical effect
+    calibrate_motor(&motor_2, 1, value);
+    set_angle(&motor_2, variables[pol_2]);
+  } else {
+    fail("er03");
+  }
+}
+
 void set_camera(float value) {
   if (value == NA && exogenous[camera])
     fail("er42");
@@ -1007,6 +1905,12 @@ void take_measurements(float * measurements, float obs_counter) {
   measurements[red] = variables[red];
   measurements[green] = variables[green];
   measurements[blue] = variables[blue];
+  measurements[pattern] = variables[pattern];
+  measurements[red_2] = variables[red_2];
+  measurements[green_2] = variables[green_2];
+  measurements[blue_2] = variables[blue_2];
+  measurements[period] = variables[period];
+  measurements[led_idx] = variables[led_idx];
   
   measurements[osr_c] = variables[osr_c];
   measurements[osr_angle_1] = angle_1_oversampling;
@@ -1034,20 +1938,31 @@ void take_measurements(float * measurements, float obs_counter) {
   measurements[diode_vis_2] = variables[diode_vis_2];
   measurements[diode_vis_3] = variables[diode_vis_3];
 
-  measurements[t_ir_1] = variables[t_ir_1];
-  measurements[t_ir_2] = variables[t_ir_2];
-  measurements[t_ir_3] = variables[t_ir_3];
+  measurements[auto_ir_1] = variables[auto_ir_1];
+  measurements[auto_ir_2] = variables[auto_ir_2];
+  measurements[auto_ir_3] = variables[auto_ir_3];
 
-  measurements[t_vis_1] = variables[t_vis_1];
-  measurements[t_vis_2] = variables[t_vis_2];
-  measurements[t_vis_3] = variables[t_vis_3];
+  measurements[auto_vis_1] = variables[auto_vis_1];
+  measurements[auto_vis_2] = variables[auto_vis_2];
+  measurements[auto_vis_3] = variables[auto_vis_3];
   
   measurements[camera] = camera_flag;
+  // In ms since the start of the MSR, which a float holds exactly
+  // (unlike millis(), beyond 2^24 ms, i.e. about 4.7 hours)
+  measurements[shutter_time] = camera_shot ? (float)(last_shutter - msr_start) : NA;
+  measurements[shutter_time] = (variables[shutter_time] == NA) ? measurements[shutter_time] : variables[shutter_time];
+  measurements[burst] = variables[burst];
+  measurements[burst_interval] = variables[burst_interval];
+  measurements[bracket] = variables[bracket];
+  measurements[bracket_step] = variables[bracket_step];
+  measurements[shot] = (variables[shot] == NA) ? shot_index : variables[shot];
+  measurements[zero_1] = variables[zero_1];
+  measurements[zero_2] = variables[zero_2];
 
   // Take sensor measurements  
-  measurements[angle_1] = analog_avg(motor_1.pin_poti, angle_1_oversampling, angle_1_reference);
-  measurements[angle_2] = analog_avg(motor_2.pin_poti, angle_2_oversampling, angle_2_reference);
-  measurements[current] = analog_avg(PIN_LED_CURRENT, current_oversampling, current_reference);
+  measurements[angle_1] = adc_average(angle_1_channel, angle_1_oversampling);
+  measurements[angle_2] = adc_average(angle_2_channel, angle_2_oversampling);
+  measurements[current] = adc_average(current_channel, current_oversampling);
   // Light sensor 1
   set_pot_11_level(setting_pot_11);
   set_pot_12_level(setting_pot_12);
@@ -1055,6 +1970,8 @@ void take_measurements(float * measurements, float obs_counter) {
   LightReading reading = read_light_sensor(0);
   measurements[ir_1] = reading.ir;
   measurements[vis_1] = reading.vis;
+  measurements[t_ir_1] = reading.ir_gain; // Gains used (differ from the set
+  measurements[t_vis_1] = reading.vis_gain; // value with auto-ranging)
   set_pot_11_level(255);
   set_pot_12_level(255);
   // Light sensor 2
@@ -1064,6 +1981,8 @@ void take_measurements(float * measurements, float obs_counter) {
   reading = read_light_sensor(1);
   measurements[ir_2] = reading.ir;
   measurements[vis_2] = reading.vis;
+  measurements[t_ir_2] = reading.ir_gain; // Gains used (differ from the set
+  measurements[t_vis_2] = reading.vis_gain; // value with auto-ranging)
   set_pot_21_level(255);
   set_pot_22_level(255);
   // Light sensor 3
@@ -1073,6 +1992,8 @@ void take_measurements(float * measurements, float obs_counter) {
   reading = read_light_sensor(2);
   measurements[ir_3] = reading.ir;
   measurements[vis_3] = reading.vis;
+  measurements[t_ir_3] = reading.ir_gain; // Gains used (differ from the set
+  measurements[t_vis_3] = reading.vis_gain; // value with auto-ranging)
   set_pot_31_level(255);
   set_pot_32_level(255);
 
@@ -1086,10 +2007,76 @@ void take_measurements(float * measurements, float obs_counter) {
   measurements[vis_1] = (variables[vis_1] == NA) ? measurements[vis_1] : variables[vis_1];
   measurements[vis_2] = (variables[vis_2] == NA) ? measurements[vis_2] : variables[vis_2];
   measurements[vis_3] = (variables[vis_3] == NA) ? measurements[vis_3] : variables[vis_3];
+
+  // Light-source pattern: the phase of the frame on the LEDs, which is
+  // not redrawn while measuring
+  measurements[phase] = (variables[phase] == NA) ? drawn_phase : variables[phase];
       
   // Board & regulator voltages for diagnosis
-  measurements[v_board] = analogRead(PIN_V_BOARD);
-  measurements[v_reg] = analogRead(PIN_V_REGULATOR);
+  measurements[v_board] = adc_latest(v_board_channel);
+  measurements[v_reg] = adc_latest(v_reg_channel);
+}
+
+/* ---------------------------------------------------------------- */
+/* Configuration registry */
+
+// A chamber configuration: the manipulable variables it controls
+// itself (which are not exogenous while it is selected), the function
+// to take measurements, and the functions called when it is selected
+// and left (can be NULL)
+struct ChamberConfig {
+  const char * name;
+  const uint8_t * controlled;
+  uint8_t no_controlled;
+  void (* measure)(float * measurements, float obs_counter);
+  void (* start)();
+  void (* stop)();
+};
+
+void start_camera() {
+  camera_flag = true;
+}
+
+void stop_camera() {
+  camera_flag = false;
+  variables[camera] = 0;
+}
+
+const uint8_t camera_variables[] = {camera};
+
+#define NO_CONFIGS 2
+ChamberConfig configs[NO_CONFIGS] = {
+  {.name="standard", .controlled=NULL, .no_controlled=0, .measure=take_measurements, .start=NULL, .stop=NULL},
+  {.name="camera", .controlled=camera_variables, .no_controlled=1, .measure=take_measurements, .start=start_camera, .stop=stop_camera}};
+
+uint8_t chamber_config = 0; // Index of the selected configuration
+
+void send_chamber_config() {
+  send_string(String("CHAMBER_CONFIG,") + configs[chamber_config].name);
+  send_string(VARIABLES_LIST);
+}
+
+void set_chamber_config(String name) {
+  uint8_t selected = 0;
+  while (selected < NO_CONFIGS && !name.equals(configs[selected].name))
+    selected++;
+  if (selected == NO_CONFIGS)
+    fail("er03", name);
+  // Leave the current configuration
+  ChamberConfig * config = &configs[chamber_config];
+  if ((*config).stop != NULL)
+    (*config).stop();
+  for (int i = 0; i < (*config).no_controlled; i++)
+    exogenous[(*config).controlled[i]] = true;
+  // Select the new one
+  chamber_config = selected;
+  config = &configs[chamber_config];
+  for (int i = 0; i < (*config).no_controlled; i++) {
+    exogenous[(*config).controlled[i]] = false;
+    variables[(*config).controlled[i]] = NA;
+  }
+  if ((*config).start != NULL)
+    (*config).start();
 }
 
 /* ---------------------------------------------------------------- */
@@ -1104,7 +2091,7 @@ void setup() {
   
   // Setup display
   setup_display();
-  lcd.setRGB(32,32,32);
+  set_display_color(32,32,32);
   print_top("Initializing");
   print_bottom("  display");
 
@@ -1117,12 +2104,21 @@ void setup() {
   // test_leds();
   leds_cross();
   /* set_color(32,200,180); */
+  set_pattern(PATTERN_UNIFORM);
+  set_red_2(0);
+  set_green_2(0);
+  set_blue_2(0);
+  set_period(1000);
+  set_led_idx(0);
+  leds_dirty = false; // Keep the cross until the first commit
+  setup_frames();
   pinMode(PIN_LED_CURRENT, INPUT);
 
   // Setup voltage meters
   print_bottom("  voltmeters");
   pinMode(PIN_V_BOARD, INPUT);
   pinMode(PIN_V_REGULATOR, INPUT);
+  setup_analog();
 
   // Setup rheostats
   pinMode(53, OUTPUT);
@@ -1142,7 +2138,8 @@ void setup() {
 
   // Set up I2C Multiplexer (Hub)
   print_bottom("  multiplexer");
-  TCA.begin(Wire);
+  Wire.begin();
+  setup_multiplexer();
 
   // Set up light sensors
   print_bottom("  light sensors");
@@ -1155,25 +2152,33 @@ void setup() {
   set_diode_vis_1(DEFAULT_VIS_DIODE);
   set_t_ir_1(DEFAULT_GAIN);
   set_t_vis_1(DEFAULT_GAIN);
+  set_auto_ir_1(0);
+  set_auto_vis_1(0);
 
   setup_light_sensor(1);
   set_diode_ir_2(DEFAULT_IR_DIODE);
   set_diode_vis_2(DEFAULT_VIS_DIODE);
   set_t_ir_2(DEFAULT_GAIN);
   set_t_vis_2(DEFAULT_GAIN);
+  set_auto_ir_2(0);
+  set_auto_vis_2(0);
 
   setup_light_sensor(2);
   set_diode_ir_3(DEFAULT_IR_DIODE);
   set_diode_vis_3(DEFAULT_VIS_DIODE);
   set_t_ir_3(DEFAULT_GAIN);
   set_t_vis_3(DEFAULT_GAIN);
+  set_auto_ir_3(0);
+  set_auto_vis_3(0);
   
   // Setup polarizers
   print_bottom("  motors");
-  setup_motor(motor_1);
-  setup_motor(motor_2);
-  reset_motor(&motor_1);
-  reset_motor(&motor_2);
+  setup_motor(&motor_1);
+  setup_motor(&motor_2);
+  setup_motors();
+  home_motors();
+  variables[zero_1] = motor_1.zero; // As stored, see load_homing_record
+  variables[zero_2] = motor_2.zero;
   set_pol_1(0);
   set_pol_2(0);
 
@@ -1181,11 +2186,15 @@ void setup() {
   pinMode(PIN_CAMERA, OUTPUT);
   print_bottom("  camera");
   digitalWrite(PIN_CAMERA, HIGH);
+  set_burst(1);
+  set_burst_interval(LOW_DURATION + CAM_DELAY);
+  set_bracket(BRACKET_NONE);
+  set_bracket_step(0);
 
   // Start serial port and wait for it to become available
   print_bottom("  connection");
   Serial.begin(500000);
-  lcd.setRGB(32,128,32);
+  set_display_color(32,128,32);
   print_top("Tunnel ready");
   clear_bottom();
 
@@ -1195,12 +2204,154 @@ void setup() {
 
   // Await connection
   delay(500);
-  send_string(CHAMBER_CONFIG);
-  send_string(VARIABLES_LIST);
+  send_chamber_config();
   print_top("Tunnel OK");
   
 }
 
+// Set when an actuator changes: the ADC rings may then hold readings
+// taken before the change has settled, which the next observation must
+// not average (see discard_stale_readings)
+bool readings_stale = true; // Also for the actuators set up in setup()
+
+// Called right before an observation, once the changes have taken
+// effect (LEDs committed, motors stopped)
+void discard_stale_readings() {
+  if (readings_stale) {
+    adc_discard_all();
+    readings_stale = false;
+  }
+}
+
+/* Sets the variable with the given name */
+void set_variable(String name, float value) {
+  readings_stale = true;
+  if (name.equals("flag"))
+    set_flag(value);
+  else if (name.equals("red"))
+    set_red(value);
+  else if (name.equals("green"))
+    set_green(value);
+  else if (name.equals("blue"))
+    set_blue(value);
+  else if (name.equals("osr_c"))
+    set_osr_c(value);
+  else if (name.equals("v_c"))
+    set_v_c(value);
+  else if (name.equals("current"))
+    set_current(value);
+  else if (name.equals("pol_1"))
+    set_pol_1(value);
+  else if (name.equals("pol_2"))
+    set_pol_2(value);
+  else if (name.equals("osr_angle_1"))
+    set_osr_angle_1(value);
+  else if (name.equals("osr_angle_2"))
+    set_osr_angle_2(value);
+  else if (name.equals("v_angle_1"))
+    set_v_angle_1(value);
+  else if (name.equals("v_angle_2"))
+    set_v_angle_2(value);
+  else if (name.equals("angle_1"))
+    set_angle_1(value);
+  else if (name.equals("angle_2"))
+    set_angle_2(value);
+  else if (name.equals("ir_1"))
+    set_ir_1(value);
+  else if (name.equals("vis_1"))
+    set_vis_1(value);
+  else if (name.equals("ir_2"))
+    set_ir_2(value);
+  else if (name.equals("vis_2"))
+    set_vis_2(value);
+  else if (name.equals("ir_3"))
+    set_ir_3(value);
+  else if (name.equals("vis_3"))
+    set_vis_3(value);
+  else if (name.equals("l_11"))
+    set_l_11(value);
+  else if (name.equals("l_12"))
+    set_l_12(value);
+  else if (name.equals("l_21"))
+    set_l_21(value);
+  else if (name.equals("l_22"))
+    set_l_22(value);
+  else if (name.equals("l_31"))
+    set_l_31(value);
+  else if (name.equals("l_32"))
+    set_l_32(value);
+  else if (name.equals("diode_ir_1"))
+    set_diode_ir_1(value);
+  else if (name.equals("diode_vis_1"))
+    set_diode_vis_1(value);
+  else if (name.equals("diode_ir_2"))
+    set_diode_ir_2(value);
+  else if (name.equals("diode_vis_2"))
+    set_diode_vis_2(value);
+  else if (name.equals("diode_ir_3"))
+    set_diode_ir_3(value);
+  else if (name.equals("diode_vis_3"))
+    set_diode_vis_3(value);
+  else if (name.equals("t_ir_1"))
+    set_t_ir_1(value);
+  else if (name.equals("t_vis_1"))
+    set_t_vis_1(value);
+  else if (name.equals("t_ir_2"))
+    set_t_ir_2(value);
+  else if (name.equals("t_vis_2"))
+    set_t_vis_2(value);
+  else if (name.equals("t_ir_3"))
+    set_t_ir_3(value);
+  else if (name.equals("t_vis_3"))
+    set_t_vis_3(value);
+  else if (name.equals("camera"))
+    set_camera(value);
+  else if (name.equals("auto_ir_1"))
+    set_auto_ir_1(value);
+  else if (name.equals("auto_vis_1"))
+    set_auto_vis_1(value);
+  else if (name.equals("auto_ir_2"))
+    set_auto_ir_2(value);
+  else if (name.equals("auto_vis_2"))
+    set_auto_vis_2(value);
+  else if (name.equals("auto_ir_3"))
+    set_auto_ir_3(value);
+  else if (name.equals("auto_vis_3"))
+    set_auto_vis_3(value);
+  else if (name.equals("pattern"))
+    set_pattern(value);
+  else if (name.equals("red_2"))
+    set_red_2(value);
+  else if (name.equals("green_2"))
+    set_green_2(value);
+  else if (name.equals("blue_2"))
+    set_blue_2(value);
+  else if (name.equals("period"))
+    set_period(value);
+  else if (name.equals("led_idx"))
+    set_led_idx(value);
+  else if (name.equals("phase"))
+    set_phase(value);
+  else if (name.equals("shutter_time"))
+    set_shutter_time(value);
+  else if (name.equals("burst"))
+    set_burst(value);
+  else if (name.equals("burst_interval"))
+    set_burst_interval(value);
+  else if (name.equals("bracket"))
+    set_bracket(value);
+  else if (name.equals("bracket_step"))
+    set_bracket_step(value);
+  else if (name.equals("shot"))
+    set_shot(value);
+  else if (name.equals("zero_1"))
+    set_zero_1(value);
+  else if (name.equals("zero_2"))
+    set_zero_2(value);
+  else
+    fail("er04", name);
+}
+
 void(* resetFunc) (void) = 0; // To reset the board
 
 /* ---------------------------------------------------------------- */
@@ -1212,29 +2363,70 @@ float observation_counter = 0.0; // To number all observations produced by the c
 const float max_counter = 100000.0;
 
 void loop() {
+  // The polarizers and animated light-source patterns run in the
+  // background: until the next instruction arrives, report if the
+  // polarizers hit a limit and draw any pending frame
+  if (Serial.available() == 0) {
+    check_motor_limits();
+    yield();
+    return;
+  }
     // Read and decode an instruction from serial
   String msg = receive_string();
   Instruction instruction = decode_instruction(msg);
 
   /* MEASURE INSTRUCTION */
   if (instruction.type == MSR) {
-    // Reply correct parsing
+    // Reply correct parsing, with the number of observations that
+    // will be sent (one per shot of each burst)
     int n = (int)instruction.p1;
     int wait = (int) instruction.p2;
-    send_string(String("OK,MSR,n=" + String(n) + ",wait=" + String(wait)));
+    int shots = variables[burst];
+    // Value around which the bracketed actuator is stepped; the
+    // bracket is checked before replying, not in the middle of a burst
+    int bracketed = variables[bracket];
+    String bracket_target = bracket_names[bracketed];
+    float bracket_base = variables[bracket_variables[bracketed]];
+    if (!bracket_fits(bracketed, bracket_base, shots))
+      fail("er03", bracket_target);
+    send_string(String("OK,MSR,n=" + String((long)n * shots) + ",wait=" + String(wait)));
+    commit_leds();
+    // Measure once the polarizers have reached their angles
+    wait_motors();
     
     // Take and transmit measurements
+    msr_start = millis();
     for(int i=0; i <n; i++){
-      digitalWrite(PIN_MSR_LED, HIGH); // While reading, LED is on
-      if (camera_flag)
-        take_picture();
-      float measurements[NO_VARIABLES] = {NA};
-      take_measurements(measurements, observation_counter);
-      intervention_flag = false;
-      observation_counter = observation_counter < max_counter ? observation_counter + 1.0 : 0.0;
-      digitalWrite(PIN_MSR_LED, LOW); // While reading, LED is on
-      // Send data back
-      send_data((byte *) &measurements, sizeof(measurements));
+      unsigned long burst_start = millis();
+      for (shot_index = 0; shot_index < shots; shot_index++) {
+        if (bracketed != BRACKET_NONE) {
+          set_variable(bracket_target, bracket_base + (shot_index - (shots - 1) / 2.0) * variables[bracket_step]);
+          commit_leds();
+          wait_motors();
+        }
+        while (millis() - burst_start < shot_index * variables[burst_interval])
+          yield();
+        digitalWrite(PIN_MSR_LED, HIGH); // While reading, LED is on
+        if (camera_flag)
+          take_picture();
+        float measurements[NO_VARIABLES] = {NA};
+        measuring = true;
+        discard_stale_readings();
+        configs[chamber_config].measure(measurements, observation_counter);
+        measuring = false;
+        intervention_flag = false;
+        camera_shot = false;
+        observation_counter = observation_counter < max_counter ? observation_counter + 1.0 : 0.0;
+        digitalWrite(PIN_MSR_LED, LOW); // While reading, LED is on
+        // Send data back
+        send_data((byte *) &measurements, sizeof(measurements));
+      }
+    }
+    shot_index = 0;
+    // Back to the value the actuator was set to
+    if (bracketed != BRACKET_NONE) {
+      set_variable(bracket_target, bracket_base);
+      commit_leds();
     }
     send_string(String("OK,DONE"));
       
@@ -1242,100 +2434,60 @@ void loop() {
   } else if (instruction.type == SET) {
     digitalWrite(PIN_SET_LED, HIGH);
     float value = instruction.p2;
-    if (instruction.target.equals("flag"))
-      set_flag(value);
-    else if (instruction.target.equals("red"))
-      set_red(value);
-    else if (instruction.target.equals("green"))
-      set_green(value);
-    else if (instruction.target.equals("blue"))
-      set_blue(value);
-    else if (instruction.target.equals("osr_c"))
-      set_osr_c(value);
-    else if (instruction.target.equals("v_c"))
-      set_v_c(value);
-    else if (instruction.target.equals("current"))
-      set_current(value);
-    else if (instruction.target.equals("pol_1"))
-      set_pol_1(value);
-    else if (instruction.target.equals("pol_2"))
-      set_pol_2(value);
-    else if (instruction.target.equals("osr_angle_1"))
-      set_osr_angle_1(value);
-    else if (instruction.target.equals("osr_angle_2"))
-      set_osr_angle_2(value);
-    else if (instruction.target.equals("v_angle_1"))
-      set_v_angle_1(value);
-    else if (instruction.target.equals("v_angle_2"))
-      set_v_angle_2(value);
-    else if (instruction.target.equals("angle_1"))
-      set_angle_1(value);
-    else if (instruction.target.equals("angle_2"))
-      set_angle_2(value);
-    else if (instruction.target.equals("ir_1"))
-      set_ir_1(value);
-    else if (instruction.target.equals("vis_1"))
-      set_vis_1(value);
-    else if (instruction.target.equals("ir_2"))
-      set_ir_2(value);
-    else if (instruction.target.equals("vis_2"))
-      set_vis_2(value);
-    else if (instruction.target.equals("ir_3"))
-      set_ir_3(value);
-    else if (instruction.target.equals("vis_3"))
-      set_vis_3(value);
-    else if (instruction.target.equals("l_11"))
-      set_l_11(value);
-    else if (instruction.target.equals("l_12"))
-      set_l_12(value);
-    else if (instruction.target.equals("l_21"))
-      set_l_21(value);
-    else if (instruction.target.equals("l_22"))
-      set_l_22(value);
-    else if (instruction.target.equals("l_31"))
-      set_l_31(value);
-    else if (instruction.target.equals("l_32"))
-      set_l_32(value);
-    else if (instruction.target.equals("diode_ir_1"))
-      set_diode_ir_1(value);
-    else if (instruction.target.equals("diode_vis_1"))
-      set_diode_vis_1(value);
-    else if (instruction.target.equals("diode_ir_2"))
-      set_diode_ir_2(value);
-    else if (instruction.target.equals("diode_vis_2"))
-      set_diode_vis_2(value);
-    else if (instruction.target.equals("diode_ir_3"))
-      set_diode_ir_3(value);
-    else if (instruction.target.equals("diode_vis_3"))
-      set_diode_vis_3(value);
-    else if (instruction.target.equals("t_ir_1"))
-      set_t_ir_1(value);
-    else if (instruction.target.equals("t_vis_1"))
-      set_t_vis_1(value);
-    else if (instruction.target.equals("t_ir_2"))
-      set_t_ir_2(value);
-    else if (instruction.target.equals("t_vis_2"))
-      set_t_vis_2(value);
-    else if (instruction.target.equals("t_ir_3"))
-      set_t_ir_3(value);
-    else if (instruction.target.equals("t_vis_3"))
-      set_t_vis_3(value);
-    else if (instruction.target.equals("camera"))
-      set_camera(value);
-    else
-      fail("er04", instruction.target);
+    set_variable(instruction.target, value);
     // Send reply
     intervention_flag = true;
     send_string(String("OK,SET," + instruction.target + "=" + String(value)));
     digitalWrite(PIN_SET_LED, LOW);
 
+    /* SET MULTIPLE INSTRUCTION */
+  } else if (instruction.type == SETM) {
+    digitalWrite(PIN_SET_LED, HIGH);
+    // Pairs of name,value
+    String pairs = instruction.target;
+    String reply = "OK,SETM";
+    while (pairs.length() > 0) {
+      int sep = pairs.indexOf(',');
+      int end = pairs.indexOf(',', sep + 1);
+      if (sep < 0)
+        fail("er01", msg);
+      if (end < 0)
+        end = pairs.length();
+      String name = pairs.substring(0, sep);
+      float value = pairs.substring(sep + 1, end).toFloat();
+      set_variable(name, value);
+      reply += "," + name + "=" + String(value);
+      pairs = end < pairs.length() ? pairs.substring(end + 1) : "";
+    }
+    commit_leds();
+    // Send reply
+    intervention_flag = true;
+    send_string(reply);
+    digitalWrite(PIN_SET_LED, LOW);
+
+    /* COMMIT INSTRUCTION */
+  } else if (instruction.type == COMMIT) {
+    commit_leds();
+    send_string(String("OK,COMMIT"));
+
+    /* CONFIGURATION INSTRUCTION */
+  } else if (instruction.type == CFG) {
+    digitalWrite(PIN_SET_LED, HIGH);
+    set_chamber_config(instruction.target);
+    // Reply, followed by the new configuration and its variables
+    intervention_flag = true;
+    send_string(String("OK,CFG," + instruction.target));
+    send_chamber_config();
+    digitalWrite(PIN_SET_LED, LOW);
+
     /* RESET INSTRUCTION */
   } else if (instruction.type == RST) {
     digitalWrite(PIN_SET_LED, HIGH);
     digitalWrite(PIN_MSR_LED, HIGH);
     set_angle(&motor_1, 0);
     set_angle(&motor_2, 0);
-    // EEPROM.write(EEPROM_ADDR, 1);
+    wait_motors();
+    park_motors();
     send_string(String("OK,RST"));
     resetFunc();
       
@@ -0,0 +1,173 @@
+/* ; -*- mode: C;-*-
+
+   MIT License
+
+   Copyright (c) 2023 Juan L. Gamella
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "multiplexer.h"
+
+uint8_t current_channels = 0x00; // Channels selected in the multiplexer
+bool channels_unknown = true; // Set if the last write to the multiplexer failed
+uint8_t session_depth = 0; // Number of nested sessions
+
+// Bus speed for the devices on each channel; all start at the I2C
+// default
+uint32_t channel_clocks[8] = {I2C_CLOCK_STANDARD, I2C_CLOCK_STANDARD,
+                              I2C_CLOCK_STANDARD, I2C_CLOCK_STANDARD,
+                              I2C_CLOCK_STANDARD, I2C_CLOCK_STANDARD,
+                              I2C_CLOCK_STANDARD, I2C_CLOCK_STANDARD};
+
+/* Writes the multiplexer's control register */
+void write_multiplexer(uint8_t mask) {
+  Wire.beginTransmission(MULTIPLEXER_ADDRESS);
+  Wire.write(mask);
+  channels_unknown = (Wire.endTransmission() != 0);
+  current_channels = mask;
+}
+
+/* Enables the bus timeout and closes all channels, i.e., brings the
+   multiplexer to a known state. With the timeout, a transaction on a
+   stuck bus fails (and the TWI hardware is reset) instead of hanging
+   the board; the failure is seen as a NACK / missing bytes by the
+   device drivers */
+void setup_multiplexer() {
+  Wire.setWireTimeout(I2C_TIMEOUT, true);
+  Wire.setClock(I2C_CLOCK_STANDARD);
+  write_multiplexer(0x00);
+}
+
+/* Bus-clear procedure (section 3.1.16 of the I2C specification): a
+   device stuck in the middle of a transfer holds SDA low until it is
+   clocked out, so SCL is pulsed (up to 9 times) until SDA is
+   released. Then a STOP condition is generated, the TWI hardware is
+   re-initialized and the last selection is written again. The pins
+   are driven as open drain: LOW or released (pull-up). */
+#define BUS_CLEAR_HALF_PERIOD 5 // In microseconds, i.e., 100 kHz
+
+void release_pin(uint8_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+}
+
+void pull_pin(uint8_t pin) {
+  digitalWrite(pin, LOW);
+  pinMode(pin, OUTPUT);
+}
+
+void recover_bus() {
+  Wire.end();
+  release_pin(SDA);
+  release_pin(SCL);
+  delayMicroseconds(BUS_CLEAR_HALF_PERIOD);
+  for (uint8_t i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+    pull_pin(SCL);
+    delayMicroseconds(BUS_CLEAR_HALF_PERIOD);
+    release_pin(SCL);
+    delayMicroseconds(BUS_CLEAR_HALF_PERIOD);
+  }
+  // STOP: SDA goes high while SCL is high
+  pull_pin(SDA);
+  delayMicroseconds(BUS_CLEAR_HALF_PERIOD);
+  release_pin(SDA);
+  delayMicroseconds(BUS_CLEAR_HALF_PERIOD);
+  // Re-initialize
+  Wire.begin();
+  Wire.clearWireTimeoutFlag();
+  Wire.setWireTimeout(I2C_TIMEOUT, true);
+  Wire.setClock(I2C_CLOCK_STANDARD);
+  write_multiplexer(current_channels);
+  Wire.setClock(get_channel_clock(current_channels));
+}
+
+/* Select exactly the channels in the mask; skips the I2C transaction
+   if they are already selected. The bus speed is always set, as other
+   code (e.g., the display or Wire.begin()) may have changed it */
+void select_channels(uint8_t mask) {
+  if (mask != current_channels || channels_unknown) {
+    // The write is seen by the devices on the channels selected
+    // before and after it
+    uint32_t clock = get_channel_clock(current_channels | mask);
+    Wire.setClock(clock < MULTIPLEXER_CLOCK ? clock : MULTIPLEXER_CLOCK);
+    write_multiplexer(mask);
+  }
+  Wire.setClock(get_channel_clock(mask));
+}
+
+uint8_t selected_channels() {
+  return current_channels;
+}
+
+/* Set the bus speed for the channel(s) in the mask */
+void set_channel_clock(uint8_t mask, uint32_t clock) {
+  for (uint8_t i = 0; i < 8; i++)
+    if (mask & (1 << i))
+      channel_clocks[i] = clock;
+}
+
+/* Bus speed for a selection, i.e., that of its slowest channel */
+uint32_t get_channel_clock(uint8_t mask) {
+  if (mask == 0x00)
+    return I2C_CLOCK_STANDARD;
+  uint32_t clock = I2C_CLOCK_FAST;
+  for (uint8_t i = 0; i < 8; i++)
+    if ((mask & (1 << i)) && channel_clocks[i] < clock)
+      clock = channel_clocks[i];
+  return clock;
+}
+
+/* Self-test to choose the bus speed of a channel: starting at
+   max_clock, each speed is tried until test() (e.g., reading the
+   device's ID register) passes CLOCK_TEST_REPEATS times in a row. The
+   chosen speed is kept and returned; if no speed passed, the channel
+   falls back to standard mode and 0 is returned. */
+#define CLOCK_TEST_REPEATS 16
+#define NO_CLOCK_PROFILES 2
+const uint32_t clock_profiles[NO_CLOCK_PROFILES] = {I2C_CLOCK_FAST, I2C_CLOCK_STANDARD};
+
+uint32_t calibrate_channel_clock(uint8_t channel, uint32_t max_clock, bool (*test)()) {
+  for (uint8_t p = 0; p < NO_CLOCK_PROFILES; p++) {
+    if (clock_profiles[p] > max_clock)
+      continue;
+    set_channel_clock(channel, clock_profiles[p]);
+    MuxSession session(channel);
+    bool passed = true;
+    for (uint8_t i = 0; i < CLOCK_TEST_REPEATS && passed; i++)
+      passed = test();
+    if (passed)
+      return clock_profiles[p];
+  }
+  set_channel_clock(channel, I2C_CLOCK_STANDARD);
+  return 0;
+}
+
+MuxSession::MuxSession(uint8_t mask) {
+  previous = current_channels;
+  session_depth++;
+  select_channels(mask);
+}
+
+MuxSession::~MuxSession() {
+  session_depth--;
+  if (session_depth > 0)
+    select_channels(previous);
+}
@@ -0,0 +1,84 @@
+/* ; -*- mode: C++;-*- */
+
+/*
+   MIT License
+
+   Copyright (c) 2023 Juan L. Gamella
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/* Manages the TCA9548A I2C multiplexer (hub). The selected channels
+   are kept between accesses, and the multiplexer's control register
+   is only written when a different selection is needed.
+
+   Each channel also has a bus-speed (clock) profile, which is applied
+   every time the channel is selected.
+
+   All I2C transactions time out after I2C_TIMEOUT, and recover_bus()
+   frees a bus on which a device holds SDA low. */
+
+#ifndef MULTIPLEXER
+#define MULTIPLEXER
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <TCA9548A.h> // For the TCA_CHANNEL_X masks
+
+#define MULTIPLEXER_ADDRESS 0x70
+
+// I2C bus speeds (in Hz). Fast-mode Plus (1 MHz) is not used: the
+// ATmega2560 TWI and the TCA9548A are only rated up to 400 kHz
+#define I2C_CLOCK_STANDARD 100000
+#define I2C_CLOCK_FAST 400000
+#define MULTIPLEXER_CLOCK I2C_CLOCK_FAST // Max. rated speed of the TCA9548A
+
+#define I2C_TIMEOUT 25000 // In microseconds
+
+void setup_multiplexer();
+void recover_bus();
+void select_channels(uint8_t mask);
+uint8_t selected_channels();
+
+void set_channel_clock(uint8_t mask, uint32_t clock);
+uint32_t get_channel_clock(uint8_t mask);
+uint32_t calibrate_channel_clock(uint8_t channel, uint32_t max_clock, bool (*test)());
+
+/* Selects the given channel(s) for the lifetime of the object, to
+   group the I2C transactions with a device, e.g.
+
+     {
+       MuxSession session(TCA_CHANNEL_1);
+       ... // transactions with the device on channel 1
+     }
+
+   Sessions can be nested: when an inner session ends, the selection
+   of the enclosing session is restored. When the outermost session
+   ends the selection is left as is, so that the next session on the
+   same channel does not need to write to the multiplexer. */
+
+class MuxSession {
+public:
+  MuxSession(uint8_t mask);
+  ~MuxSession();
+private:
+  uint8_t previous;
+};
+
+#endif
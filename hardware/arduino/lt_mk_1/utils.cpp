@@ -24,12 +24,12 @@
 */
 
 #include <Arduino.h>
+#include <Wire.h>
 #include "utils.h"
 #include "rgb_lcd.h" // For RGB display
 
 /*-----------------------------------------------------------------------*/
 /* Analog sensors: microphone, amplification signals, current */
-#define MAX_ANALOG_SAMPLES 8
 
 void set_oversampling(unsigned int * setting, float value) {
   if (value == 1 || value == 2 || value == 4 || value == 8)
@@ -60,24 +60,38 @@ float get_reference_voltage(uint8_t * setting) {
   return voltage;
 }
 
-float analog_avg(int pin, int samples, uint8_t reference) {
-  // Set new analog reference; discard first measurement and wait so
-  // the ADC reading has adjusted (see page 275 of the atmega2560
-  // datasheet :
-  // https://ww1.microchip.com/downloads/en/devicedoc/atmel-2549-8-bit-avr-microcontroller-atmega640-1280-1281-2560-2561_datasheet.pdf)
-  analogReference(reference); 
-  analogRead(pin);
-  delay(5); // 4 milliseconds was too little (ADC needed didn't have time to reset); 5 was enough
-  // Take measurements
-  float avg = 0;
-  float discard = 0;
-  for (int i=0; i<MAX_ANALOG_SAMPLES; i++) {
-    if (i % (MAX_ANALOG_SAMPLES / samples) == 0)
-      avg += (float)analogRead(pin);
-    else
-      discard += (float)analogRead(pin);
+/* ------------------------------------------------------------------- */
+/* Stepper motors: acceleration ramps */
+
+/* Fills the ramp for the given start and maximum speeds (in steps/s)
+   and acceleration (in steps/s^2) and returns its length. Level i is
+   the speed reached after i steps of constant acceleration; if it
+   takes more than RAMP_SIZE steps to reach the maximum speed, the
+   last level is the fastest speed reached */
+uint8_t compute_ramp(unsigned int * ramp, float start_speed, float max_speed, float acceleration) {
+  uint8_t length = 0;
+  while (length < RAMP_SIZE) {
+    float speed = sqrt(start_speed * start_speed + 2 * acceleration * length);
+    if (speed >= max_speed) {
+      ramp[length++] = round(1e6 / max_speed);
+      break;
+    }
+    ramp[length++] = round(1e6 / speed);
   }
-  return avg / samples;
+  return length;
+}
+
+/* Speed level for the next step, given the steps remaining to the
+   target in the current direction (zero or negative if the motor has
+   to stop or turn back). The motor slows down when it needs all the
+   remaining steps to get back to the start speed. */
+uint8_t ramp_level(uint8_t level, uint8_t length, int remaining) {
+  if (remaining <= level)
+    return (level > 0) ? level - 1 : 0;
+  else if (remaining > level + 1 && level + 1 < length)
+    return level + 1;
+  else
+    return level;
 }
 
 /* ------------------------------------------------------------------- */
@@ -90,6 +104,24 @@ Instruction decode_instruction(String instruction) {
     result.type = RST;
     return result;
   }
+  // CFG,<name> selects a chamber configuration
+  if (instruction.startsWith("CFG,")) {
+    result.type = CFG;
+    result.target = instruction.substring(4);
+    return result;
+  }
+  // SETM,<name>,<value>,<name>,<value>,... sets several variables;
+  // the pairs are parsed by the caller
+  if (instruction.startsWith("SETM,")) {
+    result.type = SETM;
+    result.target = instruction.substring(5);
+    return result;
+  }
+  // COMMIT applies pending changes (see lt_mk_1.ino)
+  if (instruction.equals("COMMIT")) {
+    result.type = COMMIT;
+    return result;
+  }
   // Check correct number of parameters and recognized instruction
   int n_params = 0;
   for (int i=0; i < instruction.length(); i++) {
@@ -128,15 +160,18 @@ void setup_display() {
 }
 
 void set_display_color(byte red, byte green, byte blue) {
+  Wire.setClock(LCD_CLOCK);
   lcd.setRGB(red,green,blue);
 }
 
 void clear_top() {
+  Wire.setClock(LCD_CLOCK);
   lcd.setCursor(0,0);
   lcd.print("                ");
 }
 
 void clear_bottom() {
+  Wire.setClock(LCD_CLOCK);
   lcd.setCursor(0,1);
   lcd.print("                ");
 }
@@ -157,7 +192,7 @@ void print_bottom(String msg) {
 /* Other auxiliary functions */
 
 void fail( String msg){
-  lcd.setRGB(64,64,64);
+  set_display_color(64,64,64);
   clear_top();
   clear_bottom();
   print_top(msg);
@@ -166,7 +201,7 @@ void fail( String msg){
 }
 
 void fail(String msg, String params){
-  lcd.setRGB(64,64,64);
+  set_display_color(64,64,64);
   clear_top();
   clear_bottom();
   print_top(msg);
@@ -128,6 +128,15 @@ int16_t Dps310::readcoeffs(void)
 	getTwosComplement(&m_c21, 16);
 	m_c30 = ((uint32_t)buffer[16] << 8) | (uint32_t)buffer[17];
 	getTwosComplement(&m_c30, 16);
+
+	//the coefficients that are added to the compensation polynomial
+	//are stored in its fixed point format, so calcPressure does not
+	//need to scale them
+	m_c00 *= 1L << DPS310__COMP_Q;
+	m_c10 *= 1L << DPS310__COMP_Q;
+	m_c20 *= 1L << DPS310__COMP_Q;
+	m_c01 *= 1L << DPS310__COMP_Q;
+	m_c11 *= 1L << DPS310__COMP_Q;
 	return DPS__SUCCEEDED;
 }
 
@@ -163,35 +172,52 @@ int16_t Dps310::configPressure(uint8_t prsMr, uint8_t prsOsr)
 	return ret;
 }
 
-float Dps310::calcTemp(int32_t raw)
+//Compensation is done in fixed point, as the AVR has no FPU:
+//scaled raw results have DPS310__SCAL_Q fractional bits (Q24), and
+//the pressure polynomial is evaluated with DPS310__COMP_Q fractional
+//bits (Q8). Neither overflows over the full 24 bit raw range.
+
+//multiplies a by a Q24 value b, with rounding. a only needs more than
+//32 bits for polynomial values far outside the sensor's range, so the
+//32 x 32 -> 64 bit multiply is used whenever it fits: on the AVR, a
+//full 64 x 64 bit multiply (__muldi3) takes several times as long
+static inline int64_t mulScaled(int64_t a, int32_t b)
 {
-	float temp = raw;
+	int64_t product = (a == (int32_t)a) ? (int64_t)(int32_t)a * b : a * b;
+	return (product + (1L << (DPS310__SCAL_Q - 1))) >> DPS310__SCAL_Q;
+}
 
+float Dps310::calcTemp(int32_t raw)
+{
 	//scale temperature according to scaling table and oversampling
-	temp /= scaling_facts[m_tempOsr];
+	int32_t temp = mulScaled(raw, scaling_recips[m_tempOsr]);
 
 	//update last measured temperature
 	//it will be used for pressure compensation
 	m_lastTempScal = temp;
 
 	//Calculate compensated temperature
-	temp = m_c0Half + m_c1 * temp;
+	int64_t comp = ((int64_t)m_c0Half << DPS310__SCAL_Q) + (int64_t)m_c1 * temp;
 
-	return temp;
+	return (float)comp / (1L << DPS310__SCAL_Q);
 }
 
 float Dps310::calcPressure(int32_t raw)
 {
-	float prs = raw;
-
 	//scale pressure according to scaling table and oversampling
-	prs /= scaling_facts[m_prsOsr];
+	int32_t prs = mulScaled(raw, scaling_recips[m_prsOsr]);
 
-	//Calculate compensated pressure
-	prs = m_c00 + prs * (m_c10 + prs * (m_c20 + prs * m_c30)) + m_lastTempScal * (m_c01 + prs * (m_c11 + prs * m_c21));
+	//Calculate compensated pressure, same polynomial as
+	//c00 + prs * (c10 + prs * (c20 + prs * c30)) + temp * (c01 + prs * (c11 + prs * c21))
+	int64_t comp = mulScaled((int64_t)m_c30 << DPS310__COMP_Q, prs) + m_c20;
+	comp = mulScaled(comp, prs) + m_c10;
+	comp = mulScaled(comp, prs) + m_c00;
+	int64_t tempComp = mulScaled((int64_t)m_c21 << DPS310__COMP_Q, prs) + m_c11;
+	tempComp = mulScaled(tempComp, prs) + m_c01;
+	comp += mulScaled(tempComp, m_lastTempScal);
 
 	//return pressure
-	return prs;
+	return (float)comp / (1L << DPS310__COMP_Q);
 }
 
 int16_t Dps310::flushFIFO()
@@ -12,6 +12,12 @@
 using namespace dps;
 
 const int32_t DpsClass::scaling_facts[DPS__NUM_OF_SCAL_FACTS] = {524288, 1572864, 3670016, 7864320, 253952, 516096, 1040384, 2088960};
+// waiting times (ms) of single pressure measurements. Up to OSR 8 all
+// settings wait as long as OSR 8, so total measurement time is always the
+// same; higher settings wait their own busy time (calcBusyTime(0U, osr),
+// rounded up), plus DPS310__BUSYTIME_FAILSAFE
+const uint8_t DpsClass::single_measurement_times[DPS__NUM_OF_SCAL_FACTS] = {24, 24, 24, 24, 38, 64, 115, 217};
+const int32_t DpsClass::scaling_recips[DPS__NUM_OF_SCAL_FACTS] = {536870912, 178956971, 76695845, 35791394, 1108378657, 545392673, 270549121, 134744072};
 
 //////// 		Constructor, Destructor, begin, end			////////
 
@@ -283,9 +289,7 @@ int16_t DpsClass::measurePressureOnce(float &result, uint8_t oversamplingRate)
 	}
 
 	//wait until measurement is finished
-	// delay(calcBusyTime(0U, m_prsOsr) / DPS__BUSYTIME_SCALING);
-        delay(calcBusyTime(0U, 0x3) / DPS__BUSYTIME_SCALING); // Juan: I fixed m_prsOsr to 0x3 (8) so total measurement time is always the same; WARNING: can not use OSR > 0x3 ( 8 readings )
-	delay(DPS310__BUSYTIME_FAILSAFE);
+	delay(getSingleMeasurementTime(oversamplingRate));
 
 	ret = getSingleResult(result);
 	if (ret != DPS__SUCCEEDED)
@@ -295,6 +299,46 @@ int16_t DpsClass::measurePressureOnce(float &result, uint8_t oversamplingRate)
 	return ret;
 }
 
+uint16_t DpsClass::getSingleMeasurementTime(uint8_t oversamplingRate)
+{
+	//out of range rates get the longest wait
+	if (oversamplingRate > DPS__OVERSAMPLING_RATE_128)
+	{
+		oversamplingRate = DPS__OVERSAMPLING_RATE_128;
+	}
+	return single_measurement_times[oversamplingRate];
+}
+
+bool DpsClass::fitsMeasureBothCont(uint8_t tempMr, uint8_t tempOsr, uint8_t prsMr, uint8_t prsOsr)
+{
+	return calcBusyTime(tempMr, tempOsr) + calcBusyTime(prsMr, prsOsr) < DPS310__MAX_BUSYTIME;
+}
+
+int16_t DpsClass::measurePressureBusyTime(uint8_t oversamplingRate)
+{
+	unsigned long start = millis();
+	int16_t ret = startMeasurePressureOnce(oversamplingRate);
+	if (ret != DPS__SUCCEEDED)
+	{
+		return ret;
+	}
+
+	//poll the ready flag until the measurement is finished
+	int16_t rdy = 0;
+	while (rdy == 0 && millis() - start < DPS310__MAX_BUSYTIME / DPS__BUSYTIME_SCALING)
+	{
+		rdy = readByteBitfield(config_registers[PRS_RDY]);
+	}
+	unsigned long busyTime = millis() - start;
+
+	standby();
+	if (rdy != 1)
+	{
+		return DPS__FAIL_UNKNOWN;
+	}
+	return busyTime;
+}
+
 int16_t DpsClass::startMeasurePressureOnce(void)
 {
 	return startMeasurePressureOnce(m_prsOsr);
@@ -408,7 +452,7 @@ int16_t DpsClass::startMeasureBothCont(uint8_t tempMr,
 		return DPS__FAIL_TOOBUSY;
 	}
 	//abort if speed and precision are too high
-	if (calcBusyTime(tempMr, tempOsr) + calcBusyTime(prsMr, prsOsr) >= DPS310__MAX_BUSYTIME)
+	if (!fitsMeasureBothCont(tempMr, tempOsr, prsMr, prsOsr))
 	{
 		return DPS__FAIL_UNFINISHED;
 	}
@@ -573,7 +617,11 @@ int16_t DpsClass::readByte(uint8_t regAddress)
 
 	m_i2cbus->beginTransmission(m_slaveAddress);
 	m_i2cbus->write(regAddress);
-	m_i2cbus->endTransmission(false);
+	//abort if the slave did not acknowledge or the bus timed out
+	if (m_i2cbus->endTransmission(false) != 0)
+	{
+		return DPS__FAIL_UNKNOWN;
+	}
 	//request 1 byte from slave
 	if (m_i2cbus->requestFrom(m_slaveAddress, 1U, 1U) > 0)
 	{
@@ -783,7 +831,11 @@ int16_t DpsClass::readBlock(RegBlock_t regBlock, uint8_t *buffer)
 
 	m_i2cbus->beginTransmission(m_slaveAddress);
 	m_i2cbus->write(regBlock.regAddress);
-	m_i2cbus->endTransmission(false);
+	//abort if the slave did not acknowledge or the bus timed out
+	if (m_i2cbus->endTransmission(false) != 0)
+	{
+		return 0; //0 bytes read successfully
+	}
 	//request length bytes from slave
 	int16_t ret = m_i2cbus->requestFrom(m_slaveAddress, regBlock.length, 1U);
 	//read all received bytes to buffer
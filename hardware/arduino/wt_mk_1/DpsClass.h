@@ -167,6 +167,30 @@ class DpsClass
 	 */
 	int16_t getSingleResult(float &result);
 
+	/**
+	 * gets the time to wait between starting a single pressure measurement and reading its result
+	 *
+	 * @param oversamplingRate: 	DPS__OVERSAMPLING_RATE_1, DPS__OVERSAMPLING_RATE_2, DPS__OVERSAMPLING_RATE_4 ... DPS__OVERSAMPLING_RATE_128
+	 * @return 	waiting time in ms
+	 */
+	uint16_t getSingleMeasurementTime(uint8_t oversamplingRate);
+
+	/**
+	 * performs one pressure measurement and measures how long the DPS310 takes to finish it, by polling its ready flag
+	 *
+	 * @param oversamplingRate: 	DPS__OVERSAMPLING_RATE_1, DPS__OVERSAMPLING_RATE_2, DPS__OVERSAMPLING_RATE_4 ... DPS__OVERSAMPLING_RATE_128
+	 * @return 	busy time in ms, or a negative status code on fail
+	 */
+	int16_t measurePressureBusyTime(uint8_t oversamplingRate);
+
+	/**
+	 * checks whether the sensor can measure temperature and pressure in background mode with the given settings, i.e., whether startMeasureBothCont accepts them
+	 *
+	 * @param tempMr, tempOsr, prsMr, prsOsr: 	as in startMeasureBothCont
+	 * @return 	true if the measurements fit in the sensor's time budget
+	 */
+	bool fitsMeasureBothCont(uint8_t tempMr, uint8_t tempOsr, uint8_t prsMr, uint8_t prsOsr);
+
 	/**
 	 * starts a continuous temperature measurement with specified measurement rate and oversampling rate
 	 * If measure rate is n and oversampling rate is m, the DPS310 performs 2^(n+m) internal measurements per second. 
@@ -237,6 +261,10 @@ class DpsClass
   protected:
 	//scaling factor table
 	static const int32_t scaling_facts[DPS__NUM_OF_SCAL_FACTS];
+	//waiting times of single pressure measurements, per oversampling rate
+	static const uint8_t single_measurement_times[DPS__NUM_OF_SCAL_FACTS];
+	//reciprocals of the scaling factors, 2^48 / scaling_facts (for fixed point compensation)
+	static const int32_t scaling_recips[DPS__NUM_OF_SCAL_FACTS];
 
 	dps::Mode m_opMode;
 
@@ -261,8 +289,8 @@ class DpsClass
 	int32_t m_c21;
 	int32_t m_c30;
 
-	// last measured scaled temperature (necessary for pressure compensation)
-	float m_lastTempScal;
+	// last measured scaled temperature (necessary for pressure compensation), in fixed point
+	int32_t m_lastTempScal;
 
 	//bus specific
 	uint8_t m_SpiI2c; //0=SPI, 1=I2C
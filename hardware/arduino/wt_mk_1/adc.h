@@ -0,0 +1,67 @@
+/* ; -*- mode: C++;-*- */
+
+/*
+   MIT License
+
+   Copyright (c) 2023 Juan L. Gamella
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/* Free-running acquisition of the analog inputs. The ADC interrupt
+   converts the registered channels one after the other, without
+   pause, and keeps the last ADC_RING conversions of each channel, so
+   a measurement only averages readings that are already there.
+
+   Each channel has its own reference voltage. Switching the reference
+   is done by the interrupt when the next channel needs a different
+   one; the conversions of the following ADC_SETTLE_US are discarded,
+   while the reference voltage settles. To switch as little as
+   possible, the channels with the same reference are converted
+   together, ADC_RING times over, before moving on to the next
+   reference.
+
+   While the engine runs it owns the ADC: analogRead must not be used.
+
+   A channel can also be watched: a callback is called from the
+   interrupt when a conversion falls outside the given bounds. While
+   the other groups are converted, a watched channel is not; to watch
+   it without gaps, the engine can be locked to its reference. */
+
+#ifndef ADC_ENGINE
+#define ADC_ENGINE
+
+#include <Arduino.h>
+
+#define ADC_CHANNELS 12 // Max. number of channels
+#define ADC_RING 8 // Conversions kept per channel, i.e., max. oversampling
+#define ADC_SETTLE_US 5000 // 4 milliseconds was too little for the reference to settle; 5 was enough
+
+int adc_add_channel(uint8_t pin, uint8_t reference);
+void adc_set_reference(int channel, uint8_t reference);
+void adc_watch(int channel, int lower, int upper, void (*callback)(int channel, int value));
+void adc_start();
+void adc_lock(uint8_t reference);
+void adc_unlock();
+void adc_discard(int channel);
+void adc_discard_all();
+int adc_latest(int channel);
+float adc_average(int channel, int samples);
+
+#endif
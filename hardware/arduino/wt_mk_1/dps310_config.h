@@ -13,6 +13,10 @@
 
 #define DPS310_NUM_OF_REGMASKS 16
 
+//fixed point compensation (see Dps310::calcPressure)
+#define DPS310__SCAL_Q 24 //fractional bits of the scaled raw results
+#define DPS310__COMP_Q 8  //fractional bits of the compensation polynomial
+
 enum Interrupt_source_310_e
 {
     DPS310_NO_INTR = 0,
@@ -65,10 +65,10 @@ ParserState parser_state = WAITING_FOR_START;
 const char START_SYMBOL = '\0'; // NUL
 const char END_SYMBOL = '\4'; // EOT
 // Buffer to store bytes read from serial
-const unsigned int input_buffer_size = 64;
+const unsigned int input_buffer_size = 128;
 byte input_buffer[input_buffer_size + 1];
 int input_buffer_index;
-// Buffer to store decoded packets (size is max size of decoding a 64
+// Buffer to store decoded packets (size is max size of decoding a 128
 // character long base64 string)
 byte packet_buffer[(6 * input_buffer_size) / 8 + 1];
 
@@ -118,6 +118,10 @@ Packet receive_packet(int timeout) {
         continue;
       }
     }
+    // Let the sketch do background work in its yield(), but never in
+    // the middle of a packet
+    if (parser_state == WAITING_FOR_START)
+      yield();
   }
   // Check end conditions
   if (parser_state == PACKET_READY) {
@@ -0,0 +1,135 @@
+// Host accuracy check for the fixed point compensation in Dps310.cpp.
+//
+// Compares Dps310::calcTemp / calcPressure against a double precision
+// evaluation of the datasheet formulas, and reports the error of the
+// previous single precision float implementation next to it. Runs over the
+// typical coefficient set of a DPS310 plus random coefficient sets spanning
+// the full register widths, every oversampling rate, and raw results over
+// the full 24 bit range.
+
+#include "Dps310.h"
+#include <math.h>
+#include <stdio.h>
+#include <random>
+
+#define NO_COEFFICIENT_SETS 41
+#define RAW_MIN (-(1L << 23))
+#define RAW_MAX ((1L << 23) - 1)
+#define PRESSURE_STEP 997
+
+//exposes the protected coefficients and compensation of the driver
+class Dps310Probe : public Dps310
+{
+public:
+	//sets the coefficients as read from the sensor, see Dps310::readcoeffs
+	void setCoefficients(int32_t c0, int32_t c1, int32_t c00, int32_t c10, int32_t c01, int32_t c11, int32_t c20, int32_t c21, int32_t c30)
+	{
+		c[0] = c0; c[1] = c1; c[2] = c00; c[3] = c10; c[4] = c01;
+		c[5] = c11; c[6] = c20; c[7] = c21; c[8] = c30;
+		m_c0Half = c0 / 2;
+		m_c1 = c1;
+		m_c00 = c00 * (1L << DPS310__COMP_Q);
+		m_c10 = c10 * (1L << DPS310__COMP_Q);
+		m_c20 = c20 * (1L << DPS310__COMP_Q);
+		m_c01 = c01 * (1L << DPS310__COMP_Q);
+		m_c11 = c11 * (1L << DPS310__COMP_Q);
+		m_c21 = c21;
+		m_c30 = c30;
+	}
+
+	void setOversampling(uint8_t prsOsr, uint8_t tempOsr)
+	{
+		m_prsOsr = prsOsr;
+		m_tempOsr = tempOsr;
+	}
+
+	float temperature(int32_t raw) { return calcTemp(raw); }
+	float pressure(int32_t raw) { return calcPressure(raw); }
+
+	double scaledPressure(int32_t raw) { return (double)raw / scaling_facts[m_prsOsr]; }
+	double scaledTemperature(int32_t raw) { return (double)raw / scaling_facts[m_tempOsr]; }
+
+	//datasheet formulas in double precision
+	double referenceTemperature(double temp)
+	{
+		return (c[0] / 2) + c[1] * temp;
+	}
+	double referencePressure(double prs, double temp)
+	{
+		return c[2] + prs * (c[3] + prs * (c[6] + prs * c[8])) + temp * (c[4] + prs * (c[5] + prs * c[7]));
+	}
+
+	//previous single precision implementation of calcPressure
+	float floatPressure(int32_t raw, float temp)
+	{
+		float prs = raw;
+		prs /= scaling_facts[m_prsOsr];
+		return c[2] + prs * (c[3] + prs * (c[6] + prs * c[8])) + temp * (c[4] + prs * (c[5] + prs * c[7]));
+	}
+
+private:
+	int32_t c[9];
+};
+
+int main()
+{
+	std::mt19937 generator(1);
+	//random value of a two's complement register with the given width
+	auto registerValue = [&](int bits) {
+		std::uniform_int_distribution<int32_t> distribution(-(1L << (bits - 1)), (1L << (bits - 1)) - 1);
+		return distribution(generator);
+	};
+
+	long samples = 0, physicalSamples = 0;
+	double physicalFixed = 0, physicalFloat = 0;
+	double fullFixed = 0, fullFloat = 0;
+	double temperatureFixed = 0;
+
+	for (int set = 0; set < NO_COEFFICIENT_SETS; set++)
+	{
+		Dps310Probe sensor;
+		if (set == 0)
+			//coefficients of a typical sensor
+			sensor.setCoefficients(209, -261, 80469, -54769, -2033, 1301, -10405, 152, -1196);
+		else
+			sensor.setCoefficients(registerValue(12), registerValue(12), registerValue(20), registerValue(20),
+								   registerValue(16), registerValue(16), registerValue(16), registerValue(16), registerValue(16));
+
+		for (uint8_t prsOsr = 0; prsOsr < DPS__NUM_OF_SCAL_FACTS; prsOsr++)
+			for (uint8_t tempOsr = 0; tempOsr < DPS__NUM_OF_SCAL_FACTS; tempOsr += 3)
+			{
+				sensor.setOversampling(prsOsr, tempOsr);
+				for (int32_t rawTemp = RAW_MIN; rawTemp <= RAW_MAX; rawTemp += (1L << 23) / 7)
+				{
+					double temp = sensor.scaledTemperature(rawTemp);
+					//also stores the scaled temperature used by calcPressure
+					float fixedTemp = sensor.temperature(rawTemp);
+					temperatureFixed = fmax(temperatureFixed, fabs(fixedTemp - sensor.referenceTemperature(temp)));
+
+					for (int32_t rawPrs = RAW_MIN; rawPrs <= RAW_MAX; rawPrs += PRESSURE_STEP)
+					{
+						double prs = sensor.scaledPressure(rawPrs);
+						double reference = sensor.referencePressure(prs, temp);
+						double errorFixed = fabs(sensor.pressure(rawPrs) - reference);
+						double errorFloat = fabs(sensor.floatPressure(rawPrs, (float)temp) - reference);
+						samples++;
+						fullFixed = fmax(fullFixed, errorFixed);
+						fullFloat = fmax(fullFloat, errorFloat);
+						//scaled results the sensor actually produces
+						if (fabs(prs) <= 1 && fabs(temp) <= 1)
+						{
+							physicalSamples++;
+							physicalFixed = fmax(physicalFixed, errorFixed);
+							physicalFloat = fmax(physicalFloat, errorFloat);
+						}
+					}
+				}
+			}
+	}
+
+	printf("samples: %ld (%ld with scaled results within +-1)\n", samples, physicalSamples);
+	printf("pressure, scaled results within +-1: max error fixed %.4f Pa, float %.4f Pa\n", physicalFixed, physicalFloat);
+	printf("pressure, full raw range: max error fixed %.4g Pa, float %.4g Pa\n", fullFixed, fullFloat);
+	printf("temperature: max error fixed %.4g C\n", temperatureFixed);
+	return 0;
+}
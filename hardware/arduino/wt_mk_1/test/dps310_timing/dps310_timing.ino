@@ -0,0 +1,109 @@
+// Times the barometer compensation on the board: the fixed point
+// Dps310::calcTemp / calcPressure against the previous single precision
+// float formula. Prints the average time per call in microseconds over
+// the serial port (115200 baud). Build with `make timing` from test/.
+//
+// If a barometer is connected, it first checks that, for every
+// oversampling rate, it finishes a measurement within the waiting time
+// the tunnel uses for it (single_measurement_times in DpsClass.cpp).
+
+#include <Wire.h>
+#include "Dps310.h"
+
+#define NO_CALLS 1000
+#define MULTIPLEXER_ADDRESS 0x70
+#define BAROMETER_CHANNEL 1 // TCA9548A channel of the barometer to check (upwind)
+
+//exposes the protected compensation of the driver
+class Dps310Probe : public Dps310
+{
+public:
+  void setCoefficients()
+  {
+    //coefficients of a typical sensor, scaled as in Dps310::readcoeffs
+    m_c0Half = 209 / 2;
+    m_c1 = -261;
+    m_c00 = 80469L * (1L << DPS310__COMP_Q);
+    m_c10 = -54769L * (1L << DPS310__COMP_Q);
+    m_c01 = -2033L * (1L << DPS310__COMP_Q);
+    m_c11 = 1301L * (1L << DPS310__COMP_Q);
+    m_c20 = -10405L * (1L << DPS310__COMP_Q);
+    m_c21 = 152;
+    m_c30 = -1196;
+    m_prsOsr = 3;
+    m_tempOsr = 3;
+  }
+
+  float temperature(int32_t raw) { return calcTemp(raw); }
+  float pressure(int32_t raw) { return calcPressure(raw); }
+
+  //previous single precision implementation of calcPressure
+  float floatPressure(int32_t raw, float temp)
+  {
+    float prs = raw;
+    prs /= scaling_facts[m_prsOsr];
+    return 80469 + prs * (-54769 + prs * (-10405 + prs * -1196)) + temp * (-2033 + prs * (1301 + prs * 152));
+  }
+};
+
+Dps310Probe sensor;
+//keeps the compiler from dropping the timed calls
+volatile float sink;
+volatile int32_t raw_input = -1000000;
+
+Dps310 barometer;
+
+void check_latency() {
+  Wire.begin();
+  Wire.beginTransmission(MULTIPLEXER_ADDRESS);
+  Wire.write(1 << BAROMETER_CHANNEL);
+  Wire.endTransmission();
+  barometer.begin(Wire);
+  for (uint8_t oversampling = DPS__OVERSAMPLING_RATE_1; oversampling <= DPS__OVERSAMPLING_RATE_128; oversampling++) {
+    int16_t busy_time = barometer.measurePressureBusyTime(oversampling);
+    uint16_t wait = barometer.getSingleMeasurementTime(oversampling);
+    Serial.print("OSR ");
+    Serial.print(oversampling);
+    if (busy_time < 0) {
+      Serial.println(": no barometer");
+      return;
+    }
+    Serial.print(": busy ");
+    Serial.print(busy_time);
+    Serial.print(" ms, wait ");
+    Serial.print(wait);
+    Serial.println(busy_time > wait ? " ms, TOO SLOW" : " ms");
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  check_latency();
+  sensor.setCoefficients();
+}
+
+void loop() {
+  unsigned long start = micros();
+  for (int i = 0; i < NO_CALLS; i++)
+    sink = sensor.temperature(raw_input + i);
+  unsigned long temperature_time = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < NO_CALLS; i++)
+    sink = sensor.pressure(raw_input + i);
+  unsigned long pressure_time = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < NO_CALLS; i++)
+    sink = sensor.floatPressure(raw_input + i, 0.5);
+  unsigned long float_time = micros() - start;
+
+  Serial.print("calcTemp (fixed): ");
+  Serial.print(temperature_time / (float)NO_CALLS);
+  Serial.print(" us, calcPressure (fixed): ");
+  Serial.print(pressure_time / (float)NO_CALLS);
+  Serial.print(" us, calcPressure (float): ");
+  Serial.print(float_time / (float)NO_CALLS);
+  Serial.println(" us");
+  delay(1000);
+}
@@ -0,0 +1,21 @@
+// Minimal host stand-ins for the Arduino core, enough to compile the Dps310
+// sources for the accuracy harness. Nothing here talks to hardware.
+
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+void delay(unsigned long ms);
+unsigned long millis();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+#endif
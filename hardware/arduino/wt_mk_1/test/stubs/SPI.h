@@ -0,0 +1,27 @@
+#ifndef SPI_STUB_H
+#define SPI_STUB_H
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE3 0x0C
+
+class SPISettings
+{
+public:
+	SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass
+{
+public:
+	void begin();
+	void setDataMode(uint8_t mode);
+	uint8_t transfer(uint8_t data);
+	void beginTransaction(SPISettings settings);
+	void endTransaction();
+};
+
+extern SPIClass SPI;
+
+#endif
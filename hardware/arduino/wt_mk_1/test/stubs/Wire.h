@@ -0,0 +1,19 @@
+#ifndef WIRE_STUB_H
+#define WIRE_STUB_H
+
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+	void begin();
+	void beginTransmission(uint8_t address);
+	uint8_t endTransmission(bool stop = true);
+	size_t write(uint8_t data);
+	uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop = 1);
+	int read();
+};
+
+extern TwoWire Wire;
+
+#endif
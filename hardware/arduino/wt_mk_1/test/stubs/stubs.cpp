@@ -0,0 +1,24 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+
+TwoWire Wire;
+SPIClass SPI;
+
+void delay(unsigned long ms) {}
+unsigned long millis() { return 0; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+void TwoWire::begin() {}
+void TwoWire::beginTransmission(uint8_t address) {}
+uint8_t TwoWire::endTransmission(bool stop) { return 0; }
+size_t TwoWire::write(uint8_t data) { return 1; }
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t stop) { return 0; }
+int TwoWire::read() { return 0; }
+
+void SPIClass::begin() {}
+void SPIClass::setDataMode(uint8_t mode) {}
+uint8_t SPIClass::transfer(uint8_t data) { return 0; }
+void SPIClass::beginTransaction(SPISettings settings) {}
+void SPIClass::endTransaction() {}
@@ -32,13 +32,27 @@
 void fail( String msg);
 void fail(String msg, String params);
 
+// Reported in place of a sensor measurement if its I2C transactions
+// failed, also after recovering the bus (see multiplexer.h)
+#define I2C_ERROR -9998
+
 /*-----------------------------------------------------------------------*/
 /* Analog sensors: microphone, amplification signals, current */
 
 void set_oversampling(unsigned int * setting, float value);
 void set_reference_voltage(uint8_t * setting, float value);
 float get_reference_voltage(uint8_t * setting); // Transform to float
-float analog_avg(int pin, int samples, uint8_t reference);
+
+/* ------------------------------------------------------------------- */
+/* Stepper motors: acceleration ramps */
+
+// A ramp holds the period of a step (in microseconds) at each speed
+// level, from the start speed (level 0) up to the maximum speed. The
+// motor moves one level up or down per step (see ramp_level)
+#define RAMP_SIZE 64
+
+uint8_t compute_ramp(unsigned int * ramp, float start_speed, float max_speed, float acceleration);
+uint8_t ramp_level(uint8_t level, uint8_t length, int remaining);
 
 /* ------------------------------------------------------------------- */
 /* Instruction parser */
@@ -47,6 +61,9 @@ typedef enum instruction_type {
                                SET,
                                MSR,
                                RST,
+                               CFG,
+                               SETM,
+                               COMMIT,
                                UNK
 };
 
@@ -62,6 +79,8 @@ Instruction decode_instruction(String instruction);
 /* ------------------------------------------------------------------- */
 /* LCD display */
 
+#define LCD_CLOCK 100000 // The display sits on the main I2C bus
+
 extern rgb_lcd lcd;
 void setup_display();
 void set_display_color(byte red, byte green, byte blue);
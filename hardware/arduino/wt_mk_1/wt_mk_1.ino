@@ -72,8 +72,10 @@
 
 #include <MCP4151.h> // For digital potentiometers
 #include <TimerOne.h> // For PWM modulation of LEDs
+#include <TimerThree.h> // For the hatch stepper motor
 #include "Dps310.h" // High-precision barometer
-#include <TCA9548A.h> // For I2C Multiplexer/Hub
+#include "multiplexer.h" // I2C Multiplexer/Hub
+#include "adc.h" // Free-running acquisition of the analog inputs
 #include <Entropy.h> // for white noise generation using clock jitter
 
 /* ------------------------------------------------------------------- */
@@ -83,7 +85,13 @@
 // https://forum.arduino.cc/t/struct-not-defined-in-this-scope/66566
 
 struct Motor {
-  int position;
+  // Motion state, updated by the stepping interrupt (see step_motor)
+  volatile int position;
+  volatile int target;
+  volatile int dir;
+  volatile bool pulse; // Step pin is high
+  volatile bool moving;
+  volatile uint8_t level; // Current speed level in the ramp
   int pin_step;
   int pin_dir;
   int pin_sel_0;
@@ -93,21 +101,55 @@ struct Motor {
   bool sel_1;
   bool sel_2;
   unsigned int steps;
-  unsigned int delay;
   float ratio; // How many turns of the motor equals one turn of the actuator (~in polarizers TEETH_SMALL / TEETH_LARGE)
+  // Motion profile (in steps/s and steps/s^2), see compute_ramp
+  float start_speed; // The motor can start and stop at this speed without ramping
+  float max_speed;
+  float acceleration;
+  unsigned int ramp[RAMP_SIZE];
+  uint8_t ramp_length;
 };
 
+#define RPM_BUFFER_SIZE 16 // Tachometer periods kept per fan
+
 struct Fan {
   int pin_pwm;
   int pin_interrupt;
   float load;
-  volatile int counter;
+  bool high_res; // Resolution for fan RPM (true = microseconds timer / false = milliseconds timer)
+  // Ring buffer with the periods between tachometer ticks, only
+  // written by the interrupt (see tick_fan)
+  volatile uint32_t periods[RPM_BUFFER_SIZE];
+  volatile uint8_t head;
+  volatile unsigned long last_tick;
+  volatile bool last_res;
+  // Closed-loop RPM control (see control_fan)
+  float rpm_target; // 0 = open loop
+  float last_error; // Of the last controller update
+  float integral; // Integral term of the controller
+};
+
+struct Barometer {
+  Dps310 * sensor;
+  uint8_t channel; // TCA9548A channel the barometer is on
+  uint8_t * oversampling;
+  // Background mode: most recent sample, and sum and number of the
+  // samples taken since the last observation
+  float latest;
+  float sum;
+  unsigned int count;
+  float temperature; // Most recent temperature, also used by the sensor to compensate pressure
 };
 
 /*----------------------------*/
 /* Hatch stepper motor */
 
 Motor motor = {.position=0,
+               .target=0,
+               .dir=1,
+               .pulse=false,
+               .moving=false,
+               .level=0,
                .pin_step=PIN_STEP,
                .pin_dir=PIN_DIR,
                .pin_sel_0=PIN_SEL_0,
@@ -117,62 +159,118 @@ Motor motor = {.position=0,
                .sel_1=1,
                .sel_2=1,
                .steps=3200,
-               .delay=400,
-               .ratio=1.0};
+               .ratio=1.0,
+               .start_speed=1250,
+               .max_speed=4000,
+               .acceleration=120000};
+
+void setup_motor(Motor *motor) {
+  pinMode((*motor).pin_step,OUTPUT);
+  pinMode((*motor).pin_dir,OUTPUT);
+  pinMode((*motor).pin_sel_0,OUTPUT);
+  pinMode((*motor).pin_sel_1,OUTPUT);
+  pinMode((*motor).pin_sel_2,OUTPUT);
+  digitalWrite((*motor).pin_sel_0,(*motor).sel_0);
+  digitalWrite((*motor).pin_sel_1,(*motor).sel_1);
+  digitalWrite((*motor).pin_sel_2,(*motor).sel_2);
+  digitalWrite((*motor).pin_dir,LOW);
+  (*motor).ramp_length = compute_ramp((*motor).ramp, (*motor).start_speed, (*motor).max_speed, (*motor).acceleration);
+  // The steps are generated by the Timer3 interrupt, which only runs
+  // while the motor moves
+  Timer3.initialize((*motor).ramp[0] / 2);
+  Timer3.attachInterrupt(step_hatch);
+  Timer3.stop();
+}
 
-void setup_motor(Motor motor) {
-  pinMode(motor.pin_step,OUTPUT);
-  pinMode(motor.pin_dir,OUTPUT);
-  pinMode(motor.pin_sel_0,OUTPUT);
-  pinMode(motor.pin_sel_1,OUTPUT);
-  pinMode(motor.pin_sel_2,OUTPUT);
-  digitalWrite(motor.pin_sel_0,motor.sel_0);
-  digitalWrite(motor.pin_sel_1,motor.sel_1);
-  digitalWrite(motor.pin_sel_2,motor.sel_2);
+// Called from the Timer3 interrupt every half step period: raises or
+// lowers the step pin, so a step takes two calls. After each step the
+// speed level for the next one is chosen, and the timer period set
+// accordingly; the first step of a move is at the start speed. The
+// motor only turns back or stops at the start speed; a change of
+// direction takes one call of its own, to give the driver time to
+// register it before the next step.
+void step_motor(Motor *motor) {
+  // Steps left in the current direction
+  int remaining = ((*motor).target - (*motor).position) * (*motor).dir;
+  if ((*motor).pulse) {
+    digitalWrite((*motor).pin_step,LOW);
+    (*motor).pulse = false;
+    (*motor).position += (*motor).dir;
+    uint8_t level = ramp_level((*motor).level, (*motor).ramp_length, remaining - 1);
+    if (level != (*motor).level) {
+      (*motor).level = level;
+      Timer3.setPeriod((*motor).ramp[level] / 2);
+    }
+  } else if (remaining <= 0 && (*motor).level == 0) {
+    if (remaining == 0) {
+      (*motor).moving = false;
+      Timer3.stop();
+    } else {
+      (*motor).dir = -(*motor).dir;
+      digitalWrite((*motor).pin_dir, (*motor).dir < 0 ? HIGH : LOW);
+    }
+  } else {
+    digitalWrite((*motor).pin_step,HIGH);
+    (*motor).pulse = true;
+  }
 }
 
+void step_hatch() {
+  step_motor(&motor);
+}
+
+// Starts moving the motor by the given number of steps and returns
+// right away; the move continues in the background (see step_motor).
+// A new move while the motor is moving changes its target.
 void move_motor(Motor *motor, int steps) {
-  // Set motor direction based on sign of steps
-  int dir = 0;
-  if (steps < 0) {
-    dir = -1;
-    digitalWrite((*motor).pin_dir,HIGH);
-  } else {
-    dir = 1;
-    digitalWrite((*motor).pin_dir,LOW);
+  noInterrupts();
+  (*motor).target = (*motor).target + steps;
+  bool start = !(*motor).moving;
+  (*motor).moving = true;
+  interrupts();
+  if (start) {
+    (*motor).level = 0;
+    Timer3.setPeriod((*motor).ramp[0] / 2);
+    Timer3.start();
   }
-  // Move motor
-  for(int i = 0; i < dir*steps; i++) {
-    digitalWrite((*motor).pin_step,HIGH); 
-    delayMicroseconds((*motor).delay);
-    digitalWrite((*motor).pin_step,LOW); 
-    delayMicroseconds((*motor).delay);
+}
+
+// Blocks until the motor reaches its target. Moves take up to a few
+// seconds, so the barometer FIFOs are drained and the controllers run
+// meanwhile.
+void wait_motor(Motor *motor) {
+  while ((*motor).moving) {
+    harvest_barometers();
+    yield();
   }
-  (*motor).position = (*motor).position + steps;
 }
 
 // Higher level: takes the internal state, and calculates the
 // direction & number of steps to reach the target angle
 void set_angle(Motor *motor, float angle) {
-  float current_angle = ((float)(*motor).position / (*motor).steps) * (*motor).ratio * 360.0;
-  float distance = angle - current_angle;
+  noInterrupts();
+  int target = (*motor).target;
+  interrupts();
+  float target_angle = ((float)target / (*motor).steps) * (*motor).ratio * 360.0;
+  float distance = angle - target_angle;
   int steps = round(distance / 360.0 / (*motor).ratio * (*motor).steps);
   move_motor(motor, steps);
 }
 
-// i.e., getter function
-float read_angle(Motor motor) {
-  return ((float)motor.position / motor.steps) * motor.ratio * 360.0;
+// i.e., getter function: the current angle, also while moving
+float read_angle(Motor *motor) {
+  noInterrupts();
+  int position = (*motor).position;
+  interrupts();
+  return ((float)position / (*motor).steps) * (*motor).ratio * 360.0;
 }
 
 
 /*----------------------------*/
 /* Fans */
 
-volatile float rpm_in, rpm_out; // These store the RPM estimate
-
-Fan fan_in = {.pin_pwm = PIN_FAN_IN_PWM, .pin_interrupt = PIN_FAN_IN_TACH, .load = 0, .counter = 0};
-Fan fan_out = {.pin_pwm = PIN_FAN_OUT_PWM, .pin_interrupt = PIN_FAN_OUT_TACH, .load = 0, .counter = 0};
+Fan fan_in = {.pin_pwm = PIN_FAN_IN_PWM, .pin_interrupt = PIN_FAN_IN_TACH, .load = 0, .high_res = true};
+Fan fan_out = {.pin_pwm = PIN_FAN_OUT_PWM, .pin_interrupt = PIN_FAN_OUT_TACH, .load = 0, .high_res = true};
 
 // Intialize the PWM pins that control the fans
 void setup_fans() {
@@ -181,87 +279,204 @@ void setup_fans() {
   Timer1.pwm(fan_out.pin_pwm, 0, 40);
 }
 
-// Set PWM duty cycle
+// Set PWM duty cycle (also called from the RPM controller in the
+// Timer1 interrupt, hence the interrupts are stopped)
 void set_fan_load(Fan * fan, float load) {
+  noInterrupts();
   Timer1.setPwmDuty((*fan).pin_pwm, round(1023*load));
   (*fan).load = load;
+  interrupts();
 }
 
-// Resolution for fan RPM (true = microseconds timer / false = milliseconds timer)
-bool fan_in_high_res = true;
-bool fan_out_high_res = true;
+float get_fan_load(Fan * fan) {
+  noInterrupts();
+  float load = (*fan).load;
+  interrupts();
+  return load;
+}
 
-// These store the variables needed to estimate the RPM from the
-// tachometer pulses
-volatile unsigned long last_tick_in, last_tick_out;
-volatile bool fan_in_last_res = true;
-volatile bool fan_out_last_res = true;
 #define DEBOUNCE_MICROS 5000
 #define DEBOUNCE_MILLIS 5
 
 /* About the debounce parameter: If the time difference between to */
 /* ticks is below the debounce parameter, we assume the tick was due */
 /* to noise in the system, as a 5 milliseconds the fan would be */
-/* turning at 6K RPM, double of its max. rated speed. This also */
-/* protects against negative differences after timer counter resets */
-/* (~70 minutes for microseconds). The fan_*_last_res flags indicate */
-/* with what resolution the last tick was measured, so only ticks with */
-/* the same resolution are compared to compute the RPM. */
-
+/* turning at 6K RPM, double of its max. rated speed. The last_res */
+/* field indicates with what resolution the last tick was measured; */
+/* when the resolution changes, a zero period is stored to mark that */
+/* older periods can't be compared with the new ones. */
+
+// Interrupt: stores the period since the last tick. Only integer
+// arithmetic here, the RPM is computed when it is read (see get_rpm)
+void tick_fan(Fan * fan) {
+  unsigned long now = (*fan).high_res ? micros() : millis();
+  uint32_t period = now - (*fan).last_tick;
+  (*fan).last_tick = now;
+  if ((*fan).high_res != (*fan).last_res)
+    period = 0;
+  else if (period <= ((*fan).high_res ? DEBOUNCE_MICROS : DEBOUNCE_MILLIS))
+    return;
+  (*fan).last_res = (*fan).high_res;
+  (*fan).periods[(*fan).head % RPM_BUFFER_SIZE] = period;
+  (*fan).head++; // Single byte, so the getter sees it change atomically
+}
 
 void tick_fan_in(){
-  if (fan_in_high_res) {
-    unsigned long now = micros();
-    float diff = (float) now - (float) last_tick_in;
-    last_tick_in = now;
-    if (diff > DEBOUNCE_MICROS && fan_in_last_res) {
-      rpm_in = 30000000 / diff;
-    }
-    fan_in_last_res = true;
-  } else {
-    unsigned long now = millis();
-    float diff = (float) now - (float) last_tick_in;
-    last_tick_in = now;
-    if (diff > DEBOUNCE_MILLIS && !fan_in_last_res) {
-      rpm_in = 30000 / diff;
-    }
-    fan_in_last_res = false;
-  }
+  tick_fan(&fan_in);
 }
 
 void tick_fan_out(){
-  if (fan_out_high_res) {
-    unsigned long now = micros();
-    float diff = (float) now - (float) last_tick_out;
-    last_tick_out = now;
-    if (diff > DEBOUNCE_MICROS && fan_out_last_res) {
-      rpm_out = 30000000 / diff;
+  tick_fan(&fan_out);
+}
+
+// How the RPM is estimated from the last tach_window periods
+#define RPM_MEAN 0
+#define RPM_MEDIAN 1
+#define RPM_TRIMMED 2 // Mean without the shortest and longest periods
+
+uint8_t tach_window = 1;
+uint8_t tach_filter = RPM_MEAN;
+
+// Without a tick for this long the fan is taken as stopped (two ticks
+// per revolution, so below 30 RPM)
+#define STALL_MILLIS 1000
+
+// Estimates the RPM from the most recent periods of the ring
+// buffer. The buffer is read without stopping interrupts: if a tick
+// arrives while copying, the copy is repeated. The time since the last
+// tick is a lower bound on the period in progress, so the estimate
+// falls when the fan slows down or stalls instead of holding the last
+// period.
+float get_rpm(Fan * fan) {
+  uint32_t periods[RPM_BUFFER_SIZE];
+  uint8_t head, n;
+  bool high_res;
+  unsigned long last_tick;
+  do {
+    head = (*fan).head;
+    high_res = (*fan).last_res;
+    noInterrupts(); // Also written by debounced ticks, which leave head as is
+    last_tick = (*fan).last_tick;
+    interrupts();
+    n = 0;
+    while (n < tach_window) {
+      uint32_t period = (*fan).periods[(uint8_t)(head - 1 - n) % RPM_BUFFER_SIZE];
+      if (period == 0)
+        break;
+      periods[n++] = period;
     }
-    fan_out_last_res = true;
-  } else {
-    unsigned long now = millis();
-    float diff = (float) now - (float) last_tick_out;
-    last_tick_out = now;
-    if (diff > DEBOUNCE_MILLIS && !fan_out_last_res) {
-      rpm_out = 30000 / diff;
+  } while (head != (*fan).head);
+  if (n == 0)
+    return 0;
+  uint32_t elapsed = (high_res ? micros() : millis()) - last_tick;
+  if (elapsed > (high_res ? STALL_MILLIS * 1000UL : STALL_MILLIS))
+    return 0;
+
+  // Sort the periods (insertion sort, there are few of them)
+  if (tach_filter != RPM_MEAN) {
+    for (int i = 1; i < n; i++) {
+      uint32_t period = periods[i];
+      int j = i - 1;
+      for (; j >= 0 && periods[j] > period; j--)
+        periods[j + 1] = periods[j];
+      periods[j + 1] = period;
+    }
+  }
+  float period;
+  if (tach_filter == RPM_MEDIAN)
+    period = (n % 2) ? periods[n / 2] : (periods[n / 2 - 1] + periods[n / 2]) / 2.0;
+  else {
+    uint8_t first = 0, last = n;
+    if (tach_filter == RPM_TRIMMED && n > 2) {
+      first++;
+      last--;
     }
-    fan_out_last_res = false;
+    uint32_t sum = 0;
+    for (int i = first; i < last; i++)
+      sum += periods[i];
+    period = (float)sum / (last - first);
   }
+  if (elapsed > period)
+    period = elapsed;
+  // Two tachometer ticks per revolution
+  return (high_res ? 30000000.0 : 30000.0) / period;
 }
 
-// Getter functions must stop interrupts while they read the RPM value
 float get_rpm_in() {
-  noInterrupts();
-  float rpm = rpm_in;
-  interrupts();
-  return rpm;
+  return get_rpm(&fan_in);
 }
 
 float get_rpm_out() {
-  noInterrupts();
-  float rpm = rpm_out;
-  interrupts();
-  return rpm;
+  return get_rpm(&fan_out);
+}
+
+void set_tach_window(float value) {
+  if (value >= 1 && value <= RPM_BUFFER_SIZE && value == (int)value)
+    tach_window = value;
+  else
+    fail("er03");
+}
+
+void set_tach_filter(float value) {
+  if (value == RPM_MEAN || value == RPM_MEDIAN || value == RPM_TRIMMED)
+    tach_filter = value;
+  else
+    fail("er03");
+}
+
+/* Closed-loop RPM control: a PI controller per fan sets its load to */
+/* keep the RPM at rpm_target. The Timer1 interrupt flags an update */
+/* every CONTROL_TICKS ticks (see interrupt()), and it runs from the */
+/* main program as soon as possible (see run_controllers). */
+
+#define CONTROL_TICKS 1250 // Timer1 ticks (40 us) between controller updates
+#define CONTROL_DT 0.05 // Seconds between controller updates
+#define RPM_TARGET_MAX 6000
+
+float rpm_gain_p = 2e-4; // Load per RPM of error
+float rpm_gain_i = 4e-4; // Load per RPM of error and second
+
+// PI controller: the load is gain_p * error + integral, and the
+// integral term grows by gain_i * dt * error. The integral term is
+// clamped so the load stays within [0,1], which also stops it from
+// winding up; it starts from the current load, so the controller
+// takes over without a bump (see set_rpm_target).
+void control_fan(Fan * fan) {
+  if ((*fan).rpm_target <= 0)
+    return;
+  float error = (*fan).rpm_target - get_rpm(fan);
+  float proportional = rpm_gain_p * error;
+  (*fan).integral = constrain((*fan).integral + rpm_gain_i * CONTROL_DT * error, -proportional, 1 - proportional);
+  (*fan).last_error = error;
+  set_fan_load(fan, proportional + (*fan).integral);
+}
+
+volatile unsigned int control_ticks = 0;
+volatile bool control_due = false;
+
+// Called from the Timer1 interrupt, which must stay short (see
+// output_noise): only flags that the controllers are due
+void tick_fan_control() {
+  if (++control_ticks < CONTROL_TICKS)
+    return;
+  control_ticks = 0;
+  control_due = true;
+}
+
+void set_rpm_target(Fan * fan, float target) {
+  if (target < 0 || target > RPM_TARGET_MAX)
+    fail("er03");
+  float error = target - get_rpm(fan);
+  (*fan).last_error = error;
+  (*fan).integral = get_fan_load(fan) - rpm_gain_p * error;
+  (*fan).rpm_target = target;
+}
+
+void set_rpm_gain(float * gain, float value) {
+  if (value >= 0)
+    *gain = value;
+  else
+    fail("er03");
 }
 
 
@@ -272,7 +487,6 @@ Dps310 barometer_upwind = Dps310();
 Dps310 barometer_downwind = Dps310();
 Dps310 barometer_ambient = Dps310();
 Dps310 barometer_intake = Dps310();
-TCA9548A<TwoWire> TCA; // I2C Multiplexer/Hub
 
 // Oversampling rate for barometers
 uint8_t upwind_oversampling = 0x0;
@@ -280,67 +494,317 @@ uint8_t downwind_oversampling = 0x0;
 uint8_t ambient_oversampling = 0x0;
 uint8_t intake_oversampling = 0x0;
 
+// Barometer sampling modes (see baro_mode)
+#define BARO_SINGLE 0 // One conversion per observation
+#define BARO_LATEST 1 // Background mode, report the most recent sample
+#define BARO_MEAN 2 // Background mode, report the mean of the samples since the last observation
+
+uint8_t barometer_mode = BARO_SINGLE;
+uint8_t barometer_rate = DPS__MEASUREMENT_RATE_8; // Samples per second in background mode
+
+// Temperature conversions refresh the compensation term of the
+// pressure readings (see Dps310::calcPressure)
+#define TEMPERATURE_OVERSAMPLING DPS__OVERSAMPLING_RATE_2
+#define TEMPERATURE_TIMEOUT 50 // ms, to wait for a pending temperature conversion
+unsigned long temperature_period = 10000; // ms between temperature conversions in single mode
+unsigned long temperature_started;
+bool temperature_pending = false;
+
 void setup_barometers() {
-  TCA.openChannel(TCA_CHANNEL_1);
+  select_channels(TCA_CHANNEL_1);
   barometer_upwind.begin(Wire);
-  TCA.closeChannel(TCA_CHANNEL_1);
+  calibrate_barometer_clock(&barometer_upwind, TCA_CHANNEL_1);
   
-  TCA.openChannel(TCA_CHANNEL_2);
+  select_channels(TCA_CHANNEL_2);
   barometer_downwind.begin(Wire);
-  TCA.closeChannel(TCA_CHANNEL_2);
+  calibrate_barometer_clock(&barometer_downwind, TCA_CHANNEL_2);
   
-  TCA.openChannel(TCA_CHANNEL_3);
+  select_channels(TCA_CHANNEL_3);
   barometer_ambient.begin(Wire);
-  TCA.closeChannel(TCA_CHANNEL_3);
+  calibrate_barometer_clock(&barometer_ambient, TCA_CHANNEL_3);
 
-  TCA.openChannel(TCA_CHANNEL_7);
+  select_channels(TCA_CHANNEL_7);
   barometer_intake.begin(Wire);
-  TCA.closeChannel(TCA_CHANNEL_7);
+  calibrate_barometer_clock(&barometer_intake, TCA_CHANNEL_7);
+}
+
+// Fastest bus speed tried for the barometers (see
+// calibrate_channel_clock in multiplexer.cpp)
+#define BAROMETER_MAX_CLOCK I2C_CLOCK_FAST
+#define DPS310_ID_REGISTER 0x0D
+
+// Content of the ID register (revision and product ID), as read by
+// begin() at standard speed
+uint8_t barometer_id;
+
+void calibrate_barometer_clock(Dps310 * barometer, uint8_t channel) {
+  barometer_id = ((*barometer).getRevisionId() << 4) | (*barometer).getProductId();
+  calibrate_channel_clock(channel, BAROMETER_MAX_CLOCK, dps310_responds);
+}
+
+// Bus speed self-test: the ID register must read correctly
+bool dps310_responds() {
+  Wire.beginTransmission(DPS__STD_SLAVE_ADDRESS);
+  Wire.write(DPS310_ID_REGISTER);
+  if (Wire.endTransmission(false) != 0)
+    return false;
+  if (Wire.requestFrom((uint8_t)DPS__STD_SLAVE_ADDRESS, (uint8_t)1) != 1)
+    return false;
+  return Wire.read() == barometer_id;
 }
 
 void set_barometer_oversampling(uint8_t * setting, float value) {
-  if (value == 1)
-    *setting = 0x0;
-  else if (value == 2)
-    *setting = 0x1;
-  else if (value == 4)
-    *setting = 0x2;
-  else if (value == 8)
-    *setting = 0x3;
-  else
+  uint8_t oversampling = 0;
+  while (oversampling <= DPS__OVERSAMPLING_RATE_128 && (1 << oversampling) != value)
+    oversampling++;
+  if (oversampling > DPS__OVERSAMPLING_RATE_128)
     fail("er03");
+  // In background mode, the barometer must still keep up with the rate
+  if (barometer_mode != BARO_SINGLE && !background_fits(barometer_rate, oversampling))
+    fail("er03");
+  *setting = oversampling;
+  // Barometers in background mode pick up the new setting on restart
+  if (barometer_mode != BARO_SINGLE)
+    start_barometers();
 }
 
-float read_barometer_upwind() {
+// Takes a measurement with the barometer on the selected channel. If
+// it fails, the I2C bus is recovered and the measurement is tried
+// once more; if that also fails, I2C_ERROR is returned. A pending
+// temperature conversion (see start_temperatures) is collected first,
+// as the barometers are busy with it until then.
+float read_barometer(Dps310 * barometer, uint8_t oversampling) {
+  collect_temperatures();
   float pressure;
-  TCA.openChannel(TCA_CHANNEL_1);
-  barometer_upwind.measurePressureOnce(pressure, upwind_oversampling);
-  TCA.closeChannel(TCA_CHANNEL_1);
+  if ((*barometer).measurePressureOnce(pressure, oversampling) != DPS__SUCCEEDED) {
+    recover_bus();
+    // Bring the driver back to idle mode, as a failed measurement
+    // can leave it in command mode
+    (*barometer).standby();
+    if ((*barometer).measurePressureOnce(pressure, oversampling) != DPS__SUCCEEDED)
+      pressure = I2C_ERROR;
+  }
   return pressure;
 }
 
+float read_barometer_upwind() {
+  MuxSession session(TCA_CHANNEL_1);
+  return read_barometer(&barometer_upwind, upwind_oversampling);
+}
+
 float read_barometer_downwind() {
-  float pressure;
-  TCA.openChannel(TCA_CHANNEL_2);
-  barometer_downwind.measurePressureOnce(pressure, downwind_oversampling);
-  TCA.closeChannel(TCA_CHANNEL_2);
-  return pressure;
+  MuxSession session(TCA_CHANNEL_2);
+  return read_barometer(&barometer_downwind, downwind_oversampling);
 }
 
 float read_barometer_ambient() {
-  float pressure;
-  TCA.openChannel(TCA_CHANNEL_3);
-  barometer_ambient.measurePressureOnce(pressure, ambient_oversampling);
-  TCA.closeChannel(TCA_CHANNEL_3);
-  return pressure;
+  MuxSession session(TCA_CHANNEL_3);
+  return read_barometer(&barometer_ambient, ambient_oversampling);
 }
 
 float read_barometer_intake() {
-  float pressure;
-  TCA.openChannel(TCA_CHANNEL_7);
-  barometer_intake.measurePressureOnce(pressure, intake_oversampling);
-  TCA.closeChannel(TCA_CHANNEL_7);
-  return pressure;
+  MuxSession session(TCA_CHANNEL_7);
+  return read_barometer(&barometer_intake, intake_oversampling);
+}
+
+// Barometers in the order read_barometers returns them
+#define NUM_BAROMETERS 4
+Barometer barometers[NUM_BAROMETERS] = {
+  {.sensor=&barometer_upwind, .channel=TCA_CHANNEL_1, .oversampling=&upwind_oversampling},
+  {.sensor=&barometer_downwind, .channel=TCA_CHANNEL_2, .oversampling=&downwind_oversampling},
+  {.sensor=&barometer_ambient, .channel=TCA_CHANNEL_3, .oversampling=&ambient_oversampling},
+  {.sensor=&barometer_intake, .channel=TCA_CHANNEL_7, .oversampling=&intake_oversampling}};
+
+// Whether a barometer can sample in background mode at the given rate
+// and oversampling; too high a combination is rejected by the setters
+// before any setting changes (see set_barometer_mode)
+bool background_fits(uint8_t rate, uint8_t oversampling) {
+  return barometer_upwind.fitsMeasureBothCont(DPS__MEASUREMENT_RATE_1, TEMPERATURE_OVERSAMPLING, rate, oversampling);
+}
+
+bool background_fits_all(uint8_t rate) {
+  for (int i = 0; i < NUM_BAROMETERS; i++)
+    if (!background_fits(rate, *barometers[i].oversampling))
+      return false;
+  return true;
+}
+
+// Reads all barometers together: a conversion is started on each of
+// them and the results are collected after one shared wait, instead
+// of waiting for each barometer in turn. A barometer whose conversion
+// fails is measured again on its own with read_barometer.
+void read_barometers(float * pressures) {
+  bool started[NUM_BAROMETERS];
+  uint16_t wait = 0;
+  collect_temperatures();
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer barometer = barometers[i];
+    MuxSession session(barometer.channel);
+    started[i] = (*barometer.sensor).startMeasurePressureOnce(*barometer.oversampling) == DPS__SUCCEEDED;
+    wait = max(wait, (*barometer.sensor).getSingleMeasurementTime(*barometer.oversampling));
+  }
+  delay(wait);
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer barometer = barometers[i];
+    MuxSession session(barometer.channel);
+    if (started[i] && (*barometer.sensor).getSingleResult(pressures[i]) == DPS__SUCCEEDED)
+      continue;
+    (*barometer.sensor).standby();
+    pressures[i] = read_barometer(barometer.sensor, *barometer.oversampling);
+  }
+  if (millis() - temperature_started >= temperature_period)
+    start_temperatures();
+}
+
+// Starts a temperature conversion on all barometers, without waiting
+// for it: the results are collected before the next pressure reading
+// (see read_barometers and read_barometer), so it is not delayed.
+void start_temperatures() {
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    MuxSession session(barometers[i].channel);
+    (*barometers[i].sensor).startMeasureTempOnce(TEMPERATURE_OVERSAMPLING);
+  }
+  temperature_started = millis();
+  temperature_pending = true;
+}
+
+void collect_temperatures() {
+  if (!temperature_pending)
+    return;
+  temperature_pending = false;
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer * barometer = &barometers[i];
+    MuxSession session((*barometer).channel);
+    float temperature;
+    int16_t ret = (*(*barometer).sensor).getSingleResult(temperature);
+    // Only waits if the next observation came right after the start
+    while (ret == DPS__FAIL_UNFINISHED && millis() - temperature_started < TEMPERATURE_TIMEOUT)
+      ret = (*(*barometer).sensor).getSingleResult(temperature);
+    if (ret == DPS__SUCCEEDED)
+      (*barometer).temperature = temperature;
+    else
+      (*(*barometer).sensor).standby();
+  }
+}
+
+// Blocking temperature reading of all barometers (used on setup)
+void read_temperatures() {
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    MuxSession session(barometers[i].channel);
+    float temperature;
+    if ((*barometers[i].sensor).measureTempOnce(temperature, TEMPERATURE_OVERSAMPLING) == DPS__SUCCEEDED)
+      barometers[i].temperature = temperature;
+  }
+  temperature_started = millis();
+}
+
+// Shared buffers to drain the barometer FIFOs into
+float fifo_temperatures[DPS__FIFO_SIZE];
+float fifo_pressures[DPS__FIFO_SIZE];
+
+// Puts the barometers in the current sampling mode. In background
+// mode each barometer samples on its own at barometer_rate and with
+// its oversampling setting, and interleaves a temperature conversion
+// once per second (the slowest rate it supports); one blocking
+// reading is taken first so there is always a most recent sample to
+// report.
+void start_barometers() {
+  float pressures[NUM_BAROMETERS];
+  if (barometer_mode != BARO_SINGLE)
+    read_barometers(pressures);
+  collect_temperatures();
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer * barometer = &barometers[i];
+    MuxSession session((*barometer).channel);
+    (*(*barometer).sensor).standby();
+    (*barometer).sum = 0;
+    (*barometer).count = 0;
+    if (barometer_mode == BARO_SINGLE)
+      continue;
+    (*barometer).latest = pressures[i];
+    int16_t ret = (*(*barometer).sensor).startMeasureBothCont(DPS__MEASUREMENT_RATE_1, TEMPERATURE_OVERSAMPLING, barometer_rate, *(*barometer).oversampling);
+    if (ret == DPS__FAIL_UNFINISHED)
+      fail("er03"); // Rate and oversampling too high to be combined (checked by the setters)
+    else if (ret != DPS__SUCCEEDED) {
+      recover_bus();
+      (*(*barometer).sensor).standby();
+      (*(*barometer).sensor).startMeasureBothCont(DPS__MEASUREMENT_RATE_1, TEMPERATURE_OVERSAMPLING, barometer_rate, *(*barometer).oversampling);
+    }
+  }
+}
+
+// Drains the FIFOs of the barometers running in background mode
+// into their running sums, and passes new downwind samples to the
+// pressure controller. Must be called more often than the FIFO
+// (32 samples) fills up, i.e. from the main loop.
+void harvest_barometers() {
+  if (barometer_mode == BARO_SINGLE)
+    return;
+  unsigned int downwind_count = barometers[1].count;
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer * barometer = &barometers[i];
+    MuxSession session((*barometer).channel);
+    uint8_t temperature_count, pressure_count;
+    if ((*(*barometer).sensor).getContResults(fifo_temperatures, temperature_count, fifo_pressures, pressure_count) != DPS__SUCCEEDED)
+      continue;
+    for (int j = 0; j < pressure_count; j++)
+      (*barometer).sum += fifo_pressures[j];
+    (*barometer).count += pressure_count;
+    if (pressure_count > 0)
+      (*barometer).latest = fifo_pressures[pressure_count - 1];
+    if (temperature_count > 0)
+      (*barometer).temperature = fifo_temperatures[temperature_count - 1];
+  }
+  if (barometers[1].count != downwind_count) {
+    feed_pressure_control(barometers[1].latest);
+  }
+}
+
+// Reports the pressures of the barometers running in background mode
+// and starts a new averaging window. If no sample arrived since the
+// last observation, the most recent one is reported.
+void collect_barometers(float * pressures) {
+  harvest_barometers();
+  for (int i = 0; i < NUM_BAROMETERS; i++) {
+    Barometer * barometer = &barometers[i];
+    if (barometer_mode == BARO_MEAN && (*barometer).count > 0)
+      pressures[i] = (*barometer).sum / (*barometer).count;
+    else
+      pressures[i] = (*barometer).latest;
+    (*barometer).sum = 0;
+    (*barometer).count = 0;
+  }
+}
+
+void set_barometer_mode(float value) {
+  if (value != BARO_SINGLE && value != BARO_LATEST && value != BARO_MEAN)
+    fail("er03");
+  else if (value != BARO_SINGLE && !background_fits_all(barometer_rate))
+    fail("er03");
+  else {
+    barometer_mode = value;
+    start_barometers();
+  }
+}
+
+void set_barometer_temperature_period(float value) {
+  if (value >= 0)
+    temperature_period = value * 1000;
+  else
+    fail("er03");
+}
+
+void set_barometer_rate(float value) {
+  uint8_t rate = 0;
+  while (rate <= DPS__MEASUREMENT_RATE_128 && (1 << rate) != value)
+    rate++;
+  if (rate > DPS__MEASUREMENT_RATE_128)
+    fail("er03");
+  if (barometer_mode != BARO_SINGLE && !background_fits_all(rate))
+    fail("er03");
+  barometer_rate = rate;
+  if (barometer_mode != BARO_SINGLE)
+    start_barometers();
 }
 
 
@@ -395,6 +859,22 @@ uint8_t mic_reference = DEFAULT;
 uint8_t current_in_reference = DEFAULT;
 uint8_t current_out_reference = DEFAULT;
 
+// Their channels in the ADC engine (see adc.h)
+int signal_1_channel;
+int signal_2_channel;
+int mic_channel;
+int current_in_channel;
+int current_out_channel;
+
+void setup_analog() {
+  signal_1_channel = adc_add_channel(PIN_SGN_POT_1, signal_1_reference);
+  signal_2_channel = adc_add_channel(PIN_SGN_POT_2, signal_2_reference);
+  mic_channel = adc_add_channel(PIN_MIC, mic_reference);
+  current_in_channel = adc_add_channel(PIN_FAN_IN_CURRENT, current_in_reference);
+  current_out_channel = adc_add_channel(PIN_FAN_OUT_CURRENT, current_out_reference);
+  adc_start();
+}
+
 /*----------------------------*/
 /* General chamber control */
 
@@ -405,7 +885,10 @@ float control_target;
 /* CHAMBER CONFIGURATIONS */
 /*   - variables (names & exogenous or not)
      - setter functions
-     - take_measurements(...) function */
+     - take_measurements(...) function
+   All configurations share the same variables; the configuration is
+   selected at runtime with the CFG instruction (see the configuration
+   registry below) */
 
 #define NA -9999
 
@@ -414,10 +897,9 @@ float control_target;
 /*   - All manipulable variables are exogenous */
 
 // List of available variables that this board transmits through serial
-#define CHAMBER_CONFIG "CHAMBER_CONFIG,standard"
-#define VARIABLES_LIST "VARIABLES_LIST,counter,flag,intervention,hatch,pot_1,pot_2,osr_1,osr_2,osr_mic,osr_in,osr_out,osr_upwind,osr_downwind,osr_ambient,osr_intake,v_1,v_2,v_mic,v_in,v_out,load_in,load_out,current_in,current_out,res_in,res_out,rpm_in,rpm_out,pressure_upwind,pressure_downwind,pressure_ambient,pressure_intake,mic,signal_1,signal_2"
+#define VARIABLES_LIST "VARIABLES_LIST,counter,flag,intervention,hatch,pot_1,pot_2,osr_1,osr_2,osr_mic,osr_in,osr_out,osr_upwind,osr_downwind,osr_ambient,osr_intake,v_1,v_2,v_mic,v_in,v_out,load_in,load_out,current_in,current_out,res_in,res_out,rpm_in,rpm_out,pressure_upwind,pressure_downwind,pressure_ambient,pressure_intake,mic,signal_1,signal_2,baro_mode,baro_rate,baro_temp_period,temperature_upwind,temperature_downwind,temperature_ambient,temperature_intake,rpm_window,rpm_filter,rpm_target_in,rpm_target_out,rpm_kp,rpm_ki,input,error,delta_error,sum_error,gain_p,gain_i,gain_d,output,output_limit,hatch_pos,hatch_moving,rpm_error_in,rpm_error_out,rpm_integral_in,rpm_integral_out"
 
-#define NO_VARIABLES 35 // Total number of variables (to initialize arrays)
+#define NO_VARIABLES 63 // Total number of variables (to initialize arrays)
 
 #define counter 0
 #define flag 1
@@ -454,6 +936,35 @@ float control_target;
 #define mic 32
 #define signal_1 33
 #define signal_2 34
+#define baro_mode 35
+#define baro_rate 36
+#define baro_temp_period 37
+#define temperature_upwind 38
+#define temperature_downwind 39
+#define temperature_ambient 40
+#define temperature_intake 41
+#define rpm_window 42
+#define rpm_filter 43
+#define rpm_target_in 44
+#define rpm_target_out 45
+#define rpm_kp 46
+#define rpm_ki 47
+// Pressure controller (see the pressure-control configuration)
+#define input 48 // Control input, i.e., target pressure
+#define error 49
+#define delta_error 50
+#define sum_error 51
+#define gain_p 52
+#define gain_i 53
+#define gain_d 54
+#define output 55
+#define output_limit 56
+#define hatch_pos 57 // Current hatch angle, hatch is its target
+#define hatch_moving 58
+#define rpm_error_in 59
+#define rpm_error_out 60
+#define rpm_integral_in 61
+#define rpm_integral_out 62
 
 float variables[NO_VARIABLES]; // Variable array (to store measurements)
 
@@ -494,8 +1005,136 @@ bool exogenous[NO_VARIABLES] = {
                                 , false // mic
                                 , false // signal_1
                                 , false // signal_2
+                                , true // baro_mode
+                                , true // baro_rate
+                                , true // baro_temp_period
+                                , false // temperature_upwind
+                                , false // temperature_downwind
+                                , false // temperature_ambient
+                                , false // temperature_intake
+                                , true // rpm_window
+                                , true // rpm_filter
+                                , true // rpm_target_in
+                                , true // rpm_target_out
+                                , true // rpm_kp
+                                , true // rpm_ki
+                                , true // input
+                                , false // error
+                                , false // delta_error
+                                , false // sum_error
+                                , true // gain_p
+                                , true // gain_i
+                                , true // gain_d
+                                , false // output
+                                , true // output_limit
+                                , false // hatch_pos
+                                , false // hatch_moving
+                                , false // rpm_error_in
+                                , false // rpm_error_out
+                                , false // rpm_integral_in
+                                , false // rpm_integral_out
 };
 
+/* ---------------------------------------------------------------- */
+/* CONFIGURATION: pressure-control */
+/*   - A PID controller sets load_in/load_out to keep pressure_downwind
+       at the target given by input; load_in/load_out are not exogenous */
+
+// The controller is updated every CONTROL_DT seconds, together with
+// the RPM controllers (see run_controllers), whatever the serial
+// traffic. The barometers can't be read from there, so it works on
+// the most recent downwind pressure passed to it by the main program
+// (see feed_pressure_control). In background mode, a new sample is
+// passed whenever the FIFOs are drained, i.e. while idle, while
+// waiting for the hatch and at every observation; in single mode, at
+// every observation (the idle loop keeps taking them).
+
+#define PRESSURE_IDLE_LOAD 0.01 // Load of the fan not driven by the controller
+
+bool pressure_control_enabled = false;
+float pressure_feedback; // Most recent downwind pressure
+float control_gain_p = -0.5; // Per Pa of error
+float control_gain_i = -0.02; // Per Pa of accumulated error and second
+float control_gain_d = -0.005; // Per Pa per second of change in error
+float control_output_limit = 1.0;
+float control_error, control_delta_error, control_sum_error, control_output;
+
+void control_pressure() {
+  float error_now = pressure_feedback - control_target;
+  control_delta_error = error_now - control_error;
+  float unclamped = control_gain_p * error_now + control_gain_d * control_delta_error / CONTROL_DT + control_gain_i * control_sum_error;
+  control_output = constrain(unclamped, -control_output_limit, control_output_limit);
+  control_error = error_now;
+  // The error is not accumulated while the output is saturated, so
+  // the integral term does not wind up
+  if (unclamped == control_output)
+    control_sum_error += error_now * CONTROL_DT;
+  float control_in, control_out;
+  if (control_output > 0) {
+    control_in = control_output;
+    control_out = PRESSURE_IDLE_LOAD;
+  } else {
+    control_in = PRESSURE_IDLE_LOAD;
+    control_out = -control_output;
+  }
+  // Fans which are intervened or under RPM control keep their load
+  if (variables[load_in] == NA && fan_in.rpm_target == 0)
+    set_fan_load(&fan_in, control_in);
+  if (variables[load_out] == NA && fan_out.rpm_target == 0)
+    set_fan_load(&fan_out, control_out);
+}
+
+// Passes a new downwind pressure sample to the controller, or the
+// intervened value if pressure_downwind is intervened
+void feed_pressure_control(float pressure) {
+  if (variables[pressure_downwind] != NA)
+    pressure = variables[pressure_downwind];
+  pressure_feedback = pressure;
+}
+
+// Called when the configuration is selected
+void start_pressure_control() {
+  // Start from the current error, without integral action
+  control_error = pressure_feedback - control_target;
+  control_delta_error = 0;
+  control_sum_error = 0;
+  control_output = 0;
+  pressure_control_enabled = true;
+}
+
+// Called when another configuration is selected
+void stop_pressure_control() {
+  pressure_control_enabled = false;
+  // Keep the loads last set by the controller
+  if (variables[load_in] == NA)
+    variables[load_in] = get_fan_load(&fan_in);
+  if (variables[load_out] == NA)
+    variables[load_out] = get_fan_load(&fan_out);
+}
+
+/* ---------------------------------------------------------------- */
+/* Controller updates */
+
+// Runs the controllers if an update is due. Called from the main loop
+// and from yield(), so the updates also happen during delay() and
+// while waiting for serial input or for the hatch
+void run_controllers() {
+  if (!control_due)
+    return;
+  control_due = false;
+  control_fan(&fan_in);
+  control_fan(&fan_out);
+  if (pressure_control_enabled)
+    control_pressure();
+}
+
+void yield() {
+  run_controllers();
+}
+
+/* ---------------------------------------------------------------- */
+/* Measurements (all configurations) */
+
 void take_measurements(float * measurements, float obs_counter) {
   // Chamber flags
   measurements[0] = obs_counter;
@@ -520,252 +1159,140 @@ void take_measurements(float * measurements, float obs_counter) {
   measurements[v_mic] = variables[v_mic];
   measurements[v_in] = variables[v_in];
   measurements[v_out] = variables[v_out];
-  measurements[load_in] = variables[load_in];
-  measurements[load_out] = variables[load_out];
+  // Under RPM or pressure control, the load is the controller output
+  measurements[load_in] = (fan_in.rpm_target > 0 || variables[load_in] == NA) ? get_fan_load(&fan_in) : variables[load_in];
+  measurements[load_out] = (fan_out.rpm_target > 0 || variables[load_out] == NA) ? get_fan_load(&fan_out) : variables[load_out];
   measurements[res_in] = variables[res_in];
   measurements[res_out] = variables[res_out];
+  measurements[baro_mode] = variables[baro_mode];
+  measurements[baro_rate] = variables[baro_rate];
+  measurements[baro_temp_period] = variables[baro_temp_period];
+  measurements[rpm_window] = variables[rpm_window];
+  measurements[rpm_filter] = variables[rpm_filter];
+  measurements[rpm_target_in] = variables[rpm_target_in];
+  measurements[rpm_target_out] = variables[rpm_target_out];
+  measurements[rpm_kp] = variables[rpm_kp];
+  measurements[rpm_ki] = variables[rpm_ki];
+  measurements[input] = variables[input];
+  measurements[gain_p] = variables[gain_p];
+  measurements[gain_i] = variables[gain_i];
+  measurements[gain_d] = variables[gain_d];
+  measurements[output_limit] = variables[output_limit];
   
   // Sensor measurements
-  measurements[current_in] = analog_avg(PIN_FAN_IN_CURRENT, current_in_oversampling, current_in_reference);
-  measurements[current_out] = analog_avg(PIN_FAN_OUT_CURRENT, current_out_oversampling, current_out_reference);
+  measurements[current_in] = adc_average(current_in_channel, current_in_oversampling);
+  measurements[current_out] = adc_average(current_out_channel, current_out_oversampling);
   measurements[rpm_in] = get_rpm_in();
   measurements[rpm_out] = get_rpm_out();
-  measurements[pressure_upwind] = read_barometer_upwind();
-  measurements[pressure_downwind] = read_barometer_downwind();
-  measurements[pressure_ambient] = read_barometer_ambient();
-  measurements[pressure_intake] = read_barometer_intake();
-  measurements[mic] = analog_avg(PIN_MIC, mic_oversampling, mic_reference);
-  measurements[signal_1] = analog_avg(PIN_SGN_POT_1, signal_1_oversampling, signal_1_reference);
-  measurements[signal_2] = analog_avg(PIN_SGN_POT_2, signal_2_oversampling, signal_2_reference);
+  measurements[hatch_pos] = read_angle(&motor);
+  measurements[hatch_moving] = motor.moving;
+  // RPM controller state, while under control
+  measurements[rpm_error_in] = (fan_in.rpm_target > 0) ? fan_in.last_error : NA;
+  measurements[rpm_error_out] = (fan_out.rpm_target > 0) ? fan_out.last_error : NA;
+  measurements[rpm_integral_in] = (fan_in.rpm_target > 0) ? fan_in.integral : NA;
+  measurements[rpm_integral_out] = (fan_out.rpm_target > 0) ? fan_out.integral : NA;
+  float pressures[NUM_BAROMETERS];
+  if (barometer_mode == BARO_SINGLE)
+    read_barometers(pressures);
+  else
+    collect_barometers(pressures);
+  measurements[pressure_upwind] = pressures[0];
+  measurements[pressure_downwind] = pressures[1];
+  measurements[pressure_ambient] = pressures[2];
+  measurements[pressure_intake] = pressures[3];
+  measurements[temperature_upwind] = barometers[0].temperature;
+  measurements[temperature_downwind] = barometers[1].temperature;
+  measurements[temperature_ambient] = barometers[2].temperature;
+  measurements[temperature_intake] = barometers[3].temperature;
+  measurements[mic] = adc_average(mic_channel, mic_oversampling);
+  measurements[signal_1] = adc_average(signal_1_channel, signal_1_oversampling);
+  measurements[signal_2] = adc_average(signal_2_channel, signal_2_oversampling);
 
   // Overwrite if sensor is intervened (i.e. variables[target] != NA)
   measurements[current_in] = (variables[current_in] == NA) ? measurements[current_in] : variables[current_in];
   measurements[current_out] = (variables[current_out] == NA) ? measurements[current_out] : variables[current_out];
   measurements[rpm_in] = (variables[rpm_in] == NA) ? measurements[rpm_in] : variables[rpm_in];
   measurements[rpm_out] = (variables[rpm_out] == NA) ? measurements[rpm_out] : variables[rpm_out];
+  measurements[hatch_pos] = (variables[hatch_pos] == NA) ? measurements[hatch_pos] : variables[hatch_pos];
+  measurements[hatch_moving] = (variables[hatch_moving] == NA) ? measurements[hatch_moving] : variables[hatch_moving];
   measurements[pressure_upwind] = (variables[pressure_upwind] == NA) ? measurements[pressure_upwind] : variables[pressure_upwind];
   measurements[pressure_downwind] = (variables[pressure_downwind] == NA) ? measurements[pressure_downwind] : variables[pressure_downwind];
   measurements[pressure_ambient] = (variables[pressure_ambient] == NA) ? measurements[pressure_ambient] : variables[pressure_ambient];
   measurements[pressure_intake] = (variables[pressure_intake] == NA) ? measurements[pressure_intake] : variables[pressure_intake];
+  measurements[temperature_upwind] = (variables[temperature_upwind] == NA) ? measurements[temperature_upwind] : variables[temperature_upwind];
+  measurements[temperature_downwind] = (variables[temperature_downwind] == NA) ? measurements[temperature_downwind] : variables[temperature_downwind];
+  measurements[temperature_ambient] = (variables[temperature_ambient] == NA) ? measurements[temperature_ambient] : variables[temperature_ambient];
+  measurements[temperature_intake] = (variables[temperature_intake] == NA) ? measurements[temperature_intake] : variables[temperature_intake];
   measurements[mic] = (variables[mic] == NA) ? measurements[mic] : variables[mic];
   measurements[signal_1] = (variables[signal_1] == NA) ? measurements[signal_1] : variables[signal_1];
   measurements[signal_2] = (variables[signal_2] == NA) ? measurements[signal_2] : variables[signal_2];
+  // In background mode the samples reach the controller as they are
+  // harvested, the reported pressure is not a new one
+  if (barometer_mode == BARO_SINGLE) {
+    feed_pressure_control(measurements[pressure_downwind]);
+  }
+
+  // Pressure controller state
+  bool controlled = pressure_control_enabled;
+  measurements[error] = controlled ? control_error : NA;
+  measurements[delta_error] = controlled ? control_delta_error : NA;
+  measurements[sum_error] = controlled ? control_sum_error : NA;
+  measurements[output] = controlled ? control_output : NA;
 }
 
 
 /* ---------------------------------------------------------------- */
-/* Pressure-control configuration */
-/*   PID controller on load_in/load_out to keep pressure_downwind at a given level. */
-
-/* #define CHAMBER_CONFIG "CHAMBER_CONFIG,pressure-control" */
-/* #define VARIABLES_LIST "VARIABLES_LIST,counter,flag,intervention,hatch,pot_1,pot_2,osr_1,osr_2,osr_mic,osr_in,osr_out,osr_upwind,osr_downwind,osr_ambient,osr_intake,v_1,v_2,v_mic,v_in,v_out,load_in,load_out,current_in,current_out,res_in,res_out,rpm_in,rpm_out,pressure_upwind,pressure_downwind,pressure_ambient,pressure_intake,mic,signal_1,signal_2,input,error,delta_error,sum_error,gain_p,gain_i,gain_d,output" */
-
-/* #define NO_VARIABLES 43 */
-
-/* #define counter 0 */
-/* #define flag 1 */
-/* #define intervention 2 */
-/* #define hatch 3 */
-/* #define pot_1 4 */
-/* #define pot_2 5 */
-/* #define osr_1 6 */
-/* #define osr_2 7 */
-/* #define osr_mic 8 */
-/* #define osr_in 9 */
-/* #define osr_out 10 */
-/* #define osr_upwind 11 */
-/* #define osr_downwind 12 */
-/* #define osr_ambient 13 */
-/* #define osr_intake 14 */
-/* #define v_1 15 */
-/* #define v_2 16 */
-/* #define v_mic 17 */
-/* #define v_in 18 */
-/* #define v_out 19 */
-/* #define load_in 20 */
-/* #define load_out 21 */
-/* #define current_in 22 */
-/* #define current_out 23 */
-/* #define res_in 24 */
-/* #define res_out 25 */
-/* #define rpm_in 26 */
-/* #define rpm_out 27 */
-/* #define pressure_upwind 28 */
-/* #define pressure_downwind 29 */
-/* #define pressure_ambient 30 */
-/* #define pressure_intake 31 */
-/* #define mic 32 */
-/* #define signal_1 33 */
-/* #define signal_2 34 */
-/* // Control variables */
-/* #define input 35 // Control input, i.e., target pressure */
-/* #define error 36 */
-/* #define delta_error 37 */
-/* #define sum_error 38 */
-/* #define gain_p 39 */
-/* #define gain_i 40 */
-/* #define gain_d 41 */
-/* #define output 42 */
-
-/* float variables[NO_VARIABLES]; */
-
-/* bool exogenous[NO_VARIABLES] = { */
-/*                                 false // counter */
-/*                                 , true // flag */
-/*                                 , false // intervention */
-/*                                 , true // hatch */
-/*                                 , true // pot_1 */
-/*                                 , true // pot_2 */
-/*                                 , true // osr_1 */
-/*                                 , true // osr_2 */
-/*                                 , true // osr_mic */
-/*                                 , true // osr_in */
-/*                                 , true // osr_out */
-/*                                 , true // osr_upwind */
-/*                                 , true // osr_downwind */
-/*                                 , true // osr_ambient */
-/*                                 , true // osr_intake */
-/*                                 , true // v_1 */
-/*                                 , true // v_2 */
-/*                                 , true // v_mic */
-/*                                 , true // v_in */
-/*                                 , true // v_out */
-/*                                 , false // load_in */
-/*                                 , false // load_out */
-/*                                 , false // current_in */
-/*                                 , false // current_out */
-/*                                 , true // res_in */
-/*                                 , true // res_out */
-/*                                 , false // rpm_in */
-/*                                 , false // rpm_out */
-/*                                 , false // pressure_upwind */
-/*                                 , false // pressure_downwind */
-/*                                 , false // pressure_ambient */
-/*                                 , false // pressure_intake */
-/*                                 , false // mic */
-/*                                 , false // signal_1 */
-/*                                 , false // signal_2 */
-/*                                 , false // input */
-/*                                 , false // error */
-/*                                 , false // delta_error */
-/*                                 , false // sum_error */
-/*                                 , false // gain_p */
-/*                                 , false // gain_i */
-/*                                 , false // gain_d */
-/*                                 , false // output */
-/* }; */
-
-
-/* float previous_error, control_sum_error; */
-/* const float control_gain_p = -0.5; */
-/* const float control_gain_d = -0.1; */
-/* const float control_gain_i = -1e-3; */
-
-/* void take_measurements(float * measurements, float obs_counter) { */
-/*   /\* Control loop *\/ */
-/*   // NOTE: To avoid affecting measurement times, perform all */
-/*   // calculations in control loop even if load_in/load_out are */
-/*   // intervened */
-/*   // Read chamber pressure (overwrite if pressure_downwind is intervened) */
-/*   float pressure = read_barometer_downwind(); */
-/*   pressure = (variables[pressure_downwind] == NA) ? pressure : variables[pressure_downwind]; */
-/*   measurements[pressure_downwind] = pressure; */
-/*   // Compute control output */
-/*   float control_error = pressure - control_target; */
-/*   float control_delta_error = control_error - previous_error; */
-/*   float control_output = control_gain_p * control_error + control_gain_d * control_delta_error + control_gain_i * control_sum_error; */
-/*   control_output = max(min(control_output, 1.0), -1.0); */
-/*   previous_error = control_error; */
-/*   control_sum_error += control_error; */
-/*   float control_in, control_out; */
-/*   if (control_output > 0) { */
-/*     control_in = control_output; */
-/*     control_out = 0.01; */
-/*   } else { */
-/*     control_in = 0.01; */
-/*     control_out = -control_output; */
-/*   } */
-/*   // Set control output (unless load_in / load_out are intervened) */
-/*   if (variables[load_in] == NA) { */
-/*     set_fan_load(&fan_in, control_in); */
-/*     measurements[load_in] = control_in; */
-/*   } else { */
-/*     measurements[load_in] = variables[load_in]; */
-/*   } */
-/*   if (variables[load_out] == NA) { */
-/*     set_fan_load(&fan_out, control_out); */
-/*     measurements[load_out] = control_out; */
-/*   } else { */
-/*     measurements[load_out] = variables[load_out]; */
-/*   } */
-
-/*   /\* Take measurements *\/ */
-/*   // Chamber flags */
-/*   measurements[0] = obs_counter; */
-/*   measurements[flag] = variables[flag]; */
-/*   measurements[intervention] = intervention_flag; */
-
-/*   // Exogenous variables */
-/*   measurements[hatch] = variables[hatch]; */
-/*   measurements[pot_1] = variables[pot_1]; */
-/*   measurements[pot_2] = variables[pot_2]; */
-/*   measurements[osr_1] = variables[osr_1]; */
-/*   measurements[osr_2] = variables[osr_2]; */
-/*   measurements[osr_mic] = variables[osr_mic]; */
-/*   measurements[osr_in] = variables[osr_in]; */
-/*   measurements[osr_out] = variables[osr_out]; */
-/*   measurements[osr_upwind] = variables[osr_upwind]; */
-/*   measurements[osr_downwind] = variables[osr_downwind]; */
-/*   measurements[osr_ambient] = variables[osr_ambient]; */
-/*   measurements[osr_intake] = variables[osr_intake]; */
-/*   measurements[v_1] = variables[v_1]; */
-/*   measurements[v_2] = variables[v_2]; */
-/*   measurements[v_mic] = variables[v_mic]; */
-/*   measurements[v_in] = variables[v_in]; */
-/*   measurements[v_out] = variables[v_out]; */
-/*   // measurements[load_in] = variables[load_in]; Set in control loop */
-/*   // measurements[load_out] = variables[load_out]; Set in control loop */
-/*   measurements[res_in] = variables[res_in]; */
-/*   measurements[res_out] = variables[res_out]; */
-  
-/*   // Sensor measurements */
-/*   measurements[current_in] = analog_avg(PIN_FAN_IN_CURRENT, current_in_oversampling, current_in_reference); */
-/*   measurements[current_out] = analog_avg(PIN_FAN_OUT_CURRENT, current_out_oversampling, current_out_reference); */
-/*   measurements[rpm_in] = get_rpm_in(); */
-/*   measurements[rpm_out] = get_rpm_out(); */
-/*   measurements[pressure_upwind] = read_barometer_upwind(); */
-/*   // measurements[pressure_downwind] = read_barometer_downwind(); Measured in control loop */
-/*   measurements[pressure_ambient] = read_barometer_ambient(); */
-/*   measurements[pressure_intake] = read_barometer_intake(); */
-/*   measurements[mic] = analog_avg(PIN_MIC, mic_oversampling, mic_reference); */
-/*   measurements[signal_1] = analog_avg(PIN_SGN_POT_1, signal_1_oversampling, signal_1_reference); */
-/*   measurements[signal_2] = analog_avg(PIN_SGN_POT_2, signal_2_oversampling, signal_2_reference); */
-
-/*   // Overwrite if sensor is intervened (i.e. variables[var] != NA) */
-/*   measurements[current_in] = (variables[current_in] == NA) ? measurements[current_in] : variables[current_in]; */
-/*   measurements[current_out] = (variables[current_out] == NA) ? measurements[current_out] : variables[current_out]; */
-/*   measurements[rpm_in] = (variables[rpm_in] == NA) ? measurements[rpm_in] : variables[rpm_in]; */
-/*   measurements[rpm_out] = (variables[rpm_out] == NA) ? measurements[rpm_out] : variables[rpm_out]; */
-/*   measurements[pressure_upwind] = (variables[pressure_upwind] == NA) ? measurements[pressure_upwind] : variables[pressure_upwind]; */
-/*   // measurements[pressure_downwind] = (variables[pressure_downwind] == NA) ? measurements[pressure_downwind] : variables[pressure_downwind]; Measured in control loop */
-/*   measurements[pressure_ambient] = (variables[pressure_ambient] == NA) ? measurements[pressure_ambient] : variables[pressure_ambient]; */
-/*   measurements[pressure_intake] = (variables[pressure_intake] == NA) ? measurements[pressure_intake] : variables[pressure_intake]; */
-/*   measurements[mic] = (variables[mic] == NA) ? measurements[mic] : variables[mic]; */
-/*   measurements[signal_1] = (variables[signal_1] == NA) ? measurements[signal_1] : variables[signal_1]; */
-/*   measurements[signal_2] = (variables[signal_2] == NA) ? measurements[signal_2] : variables[signal_2]; */
-
-/*   // Control loop diagnosis */
-/*   measurements[input] = control_target; */
-/*   measurements[error] = control_error; */
-/*   measurements[delta_error] = control_delta_error; */
-/*   measurements[sum_error] = control_sum_error; */
-/*   measurements[gain_p] = control_gain_p; */
-/*   measurements[gain_i] = control_gain_i; */
-/*   measurements[gain_d] = control_gain_d; */
-/*   measurements[output] = control_output; */
-/* } */
+/* Configuration registry */
+
+// A chamber configuration: the manipulable variables it controls
+// itself (which are not exogenous while it is selected), the function
+// to take measurements, and the functions called when it is selected
+// and left (can be NULL)
+struct ChamberConfig {
+  const char * name;
+  const uint8_t * controlled;
+  uint8_t no_controlled;
+  void (* measure)(float * measurements, float obs_counter);
+  void (* start)();
+  void (* stop)();
+};
 
+const uint8_t pressure_control_variables[] = {load_in, load_out};
 
+#define NO_CONFIGS 2
+ChamberConfig configs[NO_CONFIGS] = {
+  {.name="standard", .controlled=NULL, .no_controlled=0, .measure=take_measurements, .start=NULL, .stop=NULL},
+  {.name="pressure-control", .controlled=pressure_control_variables, .no_controlled=2, .measure=take_measurements, .start=start_pressure_control, .stop=stop_pressure_control}};
+
+uint8_t chamber_config = 0; // Index of the selected configuration
+
+void send_chamber_config() {
+  send_string(String("CHAMBER_CONFIG,") + configs[chamber_config].name);
+  send_string(VARIABLES_LIST);
+}
+
+void set_chamber_config(String name) {
+  uint8_t selected = 0;
+  while (selected < NO_CONFIGS && !name.equals(configs[selected].name))
+    selected++;
+  if (selected == NO_CONFIGS)
+    fail("er03", name);
+  // Leave the current configuration
+  ChamberConfig * config = &configs[chamber_config];
+  if ((*config).stop != NULL)
+    (*config).stop();
+  for (int i = 0; i < (*config).no_controlled; i++)
+    exogenous[(*config).controlled[i]] = true;
+  // Select the new one
+  chamber_config = selected;
+  config = &configs[chamber_config];
+  for (int i = 0; i < (*config).no_controlled; i++) {
+    exogenous[(*config).controlled[i]] = false;
+    variables[(*config).controlled[i]] = NA;
+  }
+  if ((*config).start != NULL)
+    (*config).start();
+}
 
 
 /*-----------------------------------------------------------------------*/
@@ -845,6 +1372,7 @@ void set_v_in(float value) {
       variables[v_in] = NA;
   } else {
     set_reference_voltage(&current_in_reference,value); // Values are checked here
+    adc_set_reference(current_in_channel, current_in_reference);
     variables[v_in] = value;
   }
 }
@@ -871,6 +1399,7 @@ void set_v_out(float value) {
       variables[v_out] = NA;
   } else {
     set_reference_voltage(&current_out_reference,value); // Values are checked here
+    adc_set_reference(current_out_channel, current_out_reference);
     variables[v_out] = value;
   }
 }
@@ -897,6 +1426,7 @@ void set_v_1(float value) {
       variables[v_1] = NA;
   } else {
     set_reference_voltage(&signal_1_reference,value); // Values are checked here
+    adc_set_reference(signal_1_channel, signal_1_reference);
     variables[v_1] = value;
   }
 }
@@ -923,6 +1453,7 @@ void set_v_2(float value) {
       variables[v_2] = NA;
   } else {
     set_reference_voltage(&signal_2_reference,value); // Values are checked here
+    adc_set_reference(signal_2_channel, signal_2_reference);
     variables[v_2] = value;
   }
 }
@@ -949,6 +1480,7 @@ void set_v_mic(float value) {
       variables[v_mic] = NA;
   } else {
     set_reference_voltage(&mic_reference,value); // Values are checked here
+    adc_set_reference(mic_channel, mic_reference);
     variables[v_mic] = value;
   }
 }
@@ -1006,6 +1538,45 @@ void set_osr_intake(float value) {
   }
 }
 
+void set_baro_mode(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[baro_mode])
+      fail("er42");
+    else
+      variables[baro_mode] = NA;
+  } else {
+    set_barometer_mode(value); // Values are checked here
+    variables[baro_mode] = value;
+  }
+}
+
+void set_baro_rate(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[baro_rate])
+      fail("er42");
+    else
+      variables[baro_rate] = NA;
+  } else {
+    set_barometer_rate(value); // Values are checked here
+    variables[baro_rate] = value;
+  }
+}
+
+void set_baro_temp_period(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[baro_temp_period])
+      fail("er42");
+    else
+      variables[baro_temp_period] = NA;
+  } else {
+    set_barometer_temperature_period(value); // Values are checked here
+    variables[baro_temp_period] = value;
+  }
+}
+
 void set_load_in(float value) {
   // Check value
   if (value == NA) {
@@ -1046,7 +1617,7 @@ void set_res_in(float value) {
     else
       variables[res_in] = NA;
   } else if (value == 0 || value == 1) {
-    fan_in_high_res = (value == 1);
+    fan_in.high_res = (value == 1);
     variables[res_in] = value;
   } else
     fail("er03");
@@ -1060,12 +1631,163 @@ void set_res_out(float value) {
     else
       variables[res_out] = NA;
   } else if (value == 0 || value == 1) {
-    fan_out_high_res = (value == 1);
+    fan_out.high_res = (value == 1);
     variables[res_out] = value;
   } else
     fail("er03");
 }
 
+void set_rpm_window(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_window])
+      fail("er42");
+    else
+      variables[rpm_window] = NA;
+  } else {
+    set_tach_window(value); // Values are checked here
+    variables[rpm_window] = value;
+  }
+}
+
+void set_rpm_filter(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_filter])
+      fail("er42");
+    else
+      variables[rpm_filter] = NA;
+  } else {
+    set_tach_filter(value); // Values are checked here
+    variables[rpm_filter] = value;
+  }
+}
+
+void set_rpm_target_in(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_target_in])
+      fail("er42");
+    else
+      variables[rpm_target_in] = NA;
+  } else {
+    set_rpm_target(&fan_in, value); // Values are checked here
+    variables[rpm_target_in] = value;
+    // Back to the open-loop load when the controller is disabled
+    if (value == 0 && variables[load_in] != NA)
+      set_fan_load(&fan_in, variables[load_in]);
+  }
+}
+
+void set_rpm_target_out(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_target_out])
+      fail("er42");
+    else
+      variables[rpm_target_out] = NA;
+  } else {
+    set_rpm_target(&fan_out, value); // Values are checked here
+    variables[rpm_target_out] = value;
+    // Back to the open-loop load when the controller is disabled
+    if (value == 0 && variables[load_out] != NA)
+      set_fan_load(&fan_out, variables[load_out]);
+  }
+}
+
+void set_rpm_kp(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_kp])
+      fail("er42");
+    else
+      variables[rpm_kp] = NA;
+  } else {
+    set_rpm_gain(&rpm_gain_p, value); // Values are checked here
+    variables[rpm_kp] = value;
+  }
+}
+
+void set_rpm_ki(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[rpm_ki])
+      fail("er42");
+    else
+      variables[rpm_ki] = NA;
+  } else {
+    set_rpm_gain(&rpm_gain_i, value); // Values are checked here
+    variables[rpm_ki] = value;
+  }
+}
+
+void set_input(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[input])
+      fail("er42");
+    else
+      variables[input] = NA;
+  } else if (value > 0) {
+    control_target = value;
+    variables[input] = value;
+  } else
+    fail("er03");
+}
+
+void set_gain_p(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[gain_p])
+      fail("er42");
+    else
+      variables[gain_p] = NA;
+  } else {
+    control_gain_p = value;
+    variables[gain_p] = value;
+  }
+}
+
+void set_gain_i(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[gain_i])
+      fail("er42");
+    else
+      variables[gain_i] = NA;
+  } else {
+    control_gain_i = value;
+    variables[gain_i] = value;
+  }
+}
+
+void set_gain_d(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[gain_d])
+      fail("er42");
+    else
+      variables[gain_d] = NA;
+  } else {
+    control_gain_d = value;
+    variables[gain_d] = value;
+  }
+}
+
+void set_output_limit(float value) {
+  // Check value
+  if (value == NA) {
+    if (exogenous[output_limit])
+      fail("er42");
+    else
+      variables[output_limit] = NA;
+  } else if (value >= 0 && value <= 1) {
+    control_output_limit = value;
+    variables[output_limit] = value;
+  } else
+    fail("er03");
+}
+
 // Sensor measurements
 
 void set_current_in(float value) {
@@ -1100,6 +1822,22 @@ void set_rpm_out(float value) {
     variables[rpm_out] = value;
 }
 
+void set_hatch_pos(float value) {
+  // Check value
+  if (value == NA && exogenous[hatch_pos])
+    fail("er42");
+  else
+    variables[hatch_pos] = value;
+}
+
+void set_hatch_moving(float value) {
+  // Check value
+  if (value == NA && exogenous[hatch_moving])
+    fail("er42");
+  else
+    variables[hatch_moving] = value;
+}
+
 void set_pressure_upwind(float value) {
   // Check value
   if (value == NA && exogenous[pressure_upwind])
@@ -1132,6 +1870,38 @@ void set_pressure_intake(float value) {
     variables[pressure_intake] = value;
 }
 
+void set_temperature_upwind(float value) {
+  // Check value
+  if (value == NA && exogenous[temperature_upwind])
+    fail("er42");
+  else
+    variables[temperature_upwind] = value;
+}
+
+void set_temperature_downwind(float value) {
+  // Check value
+  if (value == NA && exogenous[temperature_downwind])
+    fail("er42");
+  else
+    variables[temperature_downwind] = value;
+}
+
+void set_temperature_ambient(float value) {
+  // Check value
+  if (value == NA && exogenous[temperature_ambient])
+    fail("er42");
+  else
+    variables[temperature_ambient] = value;
+}
+
+void set_temperature_intake(float value) {
+  // Check value
+  if (value == NA && exogenous[temperature_intake])
+    fail("er42");
+  else
+    variables[temperature_intake] = value;
+}
+
 void set_mic(float value) {
   // Check value
   if (value == NA && exogenous[mic])
@@ -1196,17 +1966,33 @@ void setup() {
   pinMode(PIN_FAN_OUT_TACH, INPUT_PULLUP);
   attachInterrupt(digitalPinToInterrupt(PIN_FAN_IN_TACH), tick_fan_in, FALLING);
   attachInterrupt(digitalPinToInterrupt(PIN_FAN_OUT_TACH), tick_fan_out, FALLING);
+  set_rpm_window(1);
+  set_rpm_filter(0);
+  set_rpm_target_in(0);
+  set_rpm_target_out(0);
+  set_rpm_kp(rpm_gain_p);
+  set_rpm_ki(rpm_gain_i);
 
   // Set up I2C Multiplexer (Hub)
   print_bottom("  multiplexer");
-  TCA.begin(Wire);
+  Wire.begin();
+  setup_multiplexer();
   
   // Set high precision barometer sensors
   print_bottom("  barometers");
   setup_barometers();
-
-  // Set target to first pressure measurement
-  control_target = read_barometer_downwind();
+  set_baro_rate(8);
+  set_baro_temp_period(10);
+  set_baro_mode(BARO_SINGLE);
+  read_temperatures();
+
+  // Pressure controller: set target to first pressure measurement
+  feed_pressure_control(read_barometer_downwind());
+  set_input(pressure_feedback);
+  set_gain_p(control_gain_p);
+  set_gain_i(control_gain_i);
+  set_gain_d(control_gain_d);
+  set_output_limit(control_output_limit);
   
   // Set up speaker and amplification circuit
   print_bottom("  speaker");
@@ -1216,6 +2002,7 @@ void setup() {
   set_pot_2(0);
   pinMode(PIN_SGN_POT_1, INPUT);
   pinMode(PIN_SGN_POT_2, INPUT);
+  setup_analog();
   // White noise on speaker pin
   pinMode(PIN_NOISE, OUTPUT);
   Entropy.initialize();
@@ -1230,12 +2017,12 @@ void setup() {
   
   // Setup motor
   print_bottom("  motor");
-  setup_motor(motor);
+  setup_motor(&motor);
 
   // Start serial port and wait for it to become available
   print_bottom("  connection");
   Serial.begin(500000);
-  lcd.setRGB(32,128,32);
+  set_display_color(32,128,32);
   print_top("Tunnel ready");
   clear_bottom();
   // Turn off diagnostic leds
@@ -1244,12 +2031,138 @@ void setup() {
 
   // Await connection
   delay(500);
-  send_string(CHAMBER_CONFIG);
-  send_string(VARIABLES_LIST);
+  send_chamber_config();
   print_top("Tunnel OK");
   
 }
 
+// Set when an actuator changes: the ADC rings may then hold readings
+// taken before the change has settled, which the next observation must
+// not average (see discard_stale_readings)
+bool readings_stale = true; // Also for the actuators set up in setup()
+
+// Called right before an observation, once the changes have taken
+// effect (LEDs committed, motors stopped)
+void discard_stale_readings() {
+  if (readings_stale) {
+    adc_discard_all();
+    readings_stale = false;
+  }
+}
+
+/* Sets the variable with the given name */
+void set_variable(String name, float value) {
+  readings_stale = true;
+  if (name.equals("flag"))
+    set_flag(value);
+  else if (name.equals("hatch"))
+    set_hatch(value);
+  else if (name.equals("pot_1"))
+    set_pot_1(value);
+  else if (name.equals("pot_2"))
+    set_pot_2(value);
+  else if (name.equals("osr_1"))
+    set_osr_1(value);
+  else if (name.equals("osr_2"))
+    set_osr_2(value);
+  else if (name.equals("osr_mic"))
+    set_osr_mic(value);
+  else if (name.equals("osr_in"))
+    set_osr_in(value);
+  else if (name.equals("osr_out"))
+    set_osr_out(value);
+  else if (name.equals("osr_upwind"))
+    set_osr_upwind(value);
+  else if (name.equals("osr_downwind"))
+    set_osr_downwind(value);
+  else if (name.equals("osr_ambient"))
+    set_osr_ambient(value);
+  else if (name.equals("osr_intake"))
+    set_osr_intake(value);
+  else if (name.equals("baro_mode"))
+    set_baro_mode(value);
+  else if (name.equals("baro_rate"))
+    set_baro_rate(value);
+  else if (name.equals("baro_temp_period"))
+    set_baro_temp_period(value);
+  else if (name.equals("v_1"))
+    set_v_1(value);
+  else if (name.equals("v_2"))
+    set_v_2(value);
+  else if (name.equals("v_mic"))
+    set_v_mic(value);
+  else if (name.equals("v_in"))
+    set_v_in(value);
+  else if (name.equals("v_out"))
+    set_v_out(value);
+  else if (name.equals("load_in"))
+    set_load_in(value);
+  else if (name.equals("load_out"))
+    set_load_out(value);
+  else if (name.equals("current_in"))
+    set_current_in(value);
+  else if (name.equals("current_out"))
+    set_current_out(value);
+  else if (name.equals("res_in"))
+    set_res_in(value);
+  else if (name.equals("res_out"))
+    set_res_out(value);
+  else if (name.equals("rpm_window"))
+    set_rpm_window(value);
+  else if (name.equals("rpm_filter"))
+    set_rpm_filter(value);
+  else if (name.equals("rpm_target_in"))
+    set_rpm_target_in(value);
+  else if (name.equals("rpm_target_out"))
+    set_rpm_target_out(value);
+  else if (name.equals("rpm_kp"))
+    set_rpm_kp(value);
+  else if (name.equals("rpm_ki"))
+    set_rpm_ki(value);
+  else if (name.equals("input"))
+    set_input(value);
+  else if (name.equals("gain_p"))
+    set_gain_p(value);
+  else if (name.equals("gain_i"))
+    set_gain_i(value);
+  else if (name.equals("gain_d"))
+    set_gain_d(value);
+  else if (name.equals("output_limit"))
+    set_output_limit(value);
+  else if (name.equals("rpm_in"))
+    set_rpm_in(value);
+  else if (name.equals("rpm_out"))
+    set_rpm_out(value);
+  else if (name.equals("hatch_pos"))
+    set_hatch_pos(value);
+  else if (name.equals("hatch_moving"))
+    set_hatch_moving(value);
+  else if (name.equals("pressure_upwind"))
+    set_pressure_upwind(value);
+  else if (name.equals("pressure_downwind"))
+    set_pressure_downwind(value);
+  else if (name.equals("pressure_ambient"))
+    set_pressure_ambient(value);
+  else if (name.equals("pressure_intake"))
+    set_pressure_intake(value);
+  else if (name.equals("temperature_upwind"))
+    set_temperature_upwind(value);
+  else if (name.equals("temperature_downwind"))
+    set_temperature_downwind(value);
+  else if (name.equals("temperature_ambient"))
+    set_temperature_ambient(value);
+  else if (name.equals("temperature_intake"))
+    set_temperature_intake(value);
+  else if (name.equals("mic"))
+    set_mic(value);
+  else if (name.equals("signal_1"))
+    set_signal_1(value);
+  else if (name.equals("signal_2"))
+    set_signal_2(value);
+  else
+    fail("er04", name);
+}
+
 void(* resetFunc) (void) = 0; // To reset the board
 
 /* ---------------------------------------------------------------- */
@@ -1262,9 +2175,15 @@ const float max_counter = 100000.0;
 float measurements[NO_VARIABLES] = {NA}; // counter + sensor readings
 
 void loop() {
+  run_controllers();
   // Read and decode an instruction from serial
   if (Serial.available() == 0) { // Nothing on the serial line
-    take_measurements(measurements,0.0);
+    // Barometers in background mode keep sampling between
+    // observations; measuring here would restart their averaging window
+    if (barometer_mode == BARO_SINGLE)
+      configs[chamber_config].measure(measurements,0.0);
+    else
+      harvest_barometers(); // Also feeds the pressure controller
   } else {
     String msg = receive_string();
     Instruction instruction = decode_instruction(msg);
@@ -1275,10 +2194,17 @@ void loop() {
       int wait = (int) instruction.p2;
       send_string(String("OK,MSR,n=" + String(n) + ",wait=" + String(wait)));
     
+      // A SET of the hatch returns before the hatch gets there, so the
+      // chamber can be observed while the hatch moves; with a non-zero
+      // wait, the observations are taken once it has stopped
+      if (wait != 0)
+        wait_motor(&motor);
+
       // Take and transmit measurements
       for(int i=0; i <n; i++){
         digitalWrite(PIN_MSR_LED, HIGH); // While reading, LED is on
-        take_measurements(measurements, observation_counter);
+        discard_stale_readings();
+        configs[chamber_config].measure(measurements, observation_counter);
         intervention_flag = false;
         observation_counter = observation_counter < max_counter ? observation_counter + 1.0 : 0.0;
         digitalWrite(PIN_MSR_LED, LOW); // While reading, LED is on
@@ -1291,88 +2217,62 @@ void loop() {
     } else if (instruction.type == SET) {     
       digitalWrite(PIN_SET_LED, HIGH);
       float value = instruction.p2;
-      if (instruction.target.equals("flag"))
-        set_flag(value);
-      else if (instruction.target.equals("hatch"))
-        set_hatch(value);
-      else if (instruction.target.equals("pot_1"))
-        set_pot_1(value);
-      else if (instruction.target.equals("pot_2"))
-        set_pot_2(value);
-      else if (instruction.target.equals("osr_1"))
-        set_osr_1(value);
-      else if (instruction.target.equals("osr_2"))
-        set_osr_2(value);
-      else if (instruction.target.equals("osr_mic"))
-        set_osr_mic(value);
-      else if (instruction.target.equals("osr_in"))
-        set_osr_in(value);
-      else if (instruction.target.equals("osr_out"))
-        set_osr_out(value);
-      else if (instruction.target.equals("osr_upwind"))
-        set_osr_upwind(value);
-      else if (instruction.target.equals("osr_downwind"))
-        set_osr_downwind(value);
-      else if (instruction.target.equals("osr_ambient"))
-        set_osr_ambient(value);
-      else if (instruction.target.equals("osr_intake"))
-        set_osr_intake(value);
-      else if (instruction.target.equals("v_1"))
-        set_v_1(value);
-      else if (instruction.target.equals("v_2"))
-        set_v_2(value);
-      else if (instruction.target.equals("v_mic"))
-        set_v_mic(value);
-      else if (instruction.target.equals("v_in"))
-        set_v_in(value);
-      else if (instruction.target.equals("v_out"))
-        set_v_out(value);
-      else if (instruction.target.equals("load_in"))
-        set_load_in(value);
-      else if (instruction.target.equals("load_out"))
-        set_load_out(value);
-      else if (instruction.target.equals("current_in"))
-        set_current_in(value);
-      else if (instruction.target.equals("current_out"))
-        set_current_out(value);
-      else if (instruction.target.equals("res_in"))
-        set_res_in(value);
-      else if (instruction.target.equals("res_out"))
-        set_res_out(value);
-      else if (instruction.target.equals("rpm_in"))
-        set_rpm_in(value);
-      else if (instruction.target.equals("rpm_out"))
-        set_rpm_out(value);
-      else if (instruction.target.equals("pressure_upwind"))
-        set_pressure_upwind(value);
-      else if (instruction.target.equals("pressure_downwind"))
-        set_pressure_downwind(value);
-      else if (instruction.target.equals("pressure_ambient"))
-        set_pressure_ambient(value);
-      else if (instruction.target.equals("pressure_intake"))
-        set_pressure_intake(value);
-      else if (instruction.target.equals("mic"))
-        set_mic(value);
-      else if (instruction.target.equals("signal_1"))
-        set_signal_1(value);
-      else if (instruction.target.equals("signal_2"))
-        set_signal_2(value);
-      else
-        fail("er04", instruction.target);
+      set_variable(instruction.target, value);
       // Send reply
       intervention_flag = true;
       send_string(String("OK,SET," + instruction.target + "=" + String(value)));
       digitalWrite(PIN_SET_LED, LOW);
 
+      /* SET MULTIPLE INSTRUCTION */
+    } else if (instruction.type == SETM) {
+      digitalWrite(PIN_SET_LED, HIGH);
+      // Pairs of name,value
+      String pairs = instruction.target;
+      String reply = "OK,SETM";
+      while (pairs.length() > 0) {
+        int sep = pairs.indexOf(',');
+        int end = pairs.indexOf(',', sep + 1);
+        if (sep < 0)
+          fail("er01", msg);
+        if (end < 0)
+          end = pairs.length();
+        String name = pairs.substring(0, sep);
+        float value = pairs.substring(sep + 1, end).toFloat();
+        set_variable(name, value);
+        reply += "," + name + "=" + String(value);
+        pairs = end < pairs.length() ? pairs.substring(end + 1) : "";
+      }
+      // Send reply
+      intervention_flag = true;
+      send_string(reply);
+      digitalWrite(PIN_SET_LED, LOW);
+
+      /* COMMIT INSTRUCTION */
+    } else if (instruction.type == COMMIT) {
+      // Nothing is deferred in this chamber
+      send_string(String("OK,COMMIT"));
+
+
+      /* CONFIGURATION INSTRUCTION */
+    } else if (instruction.type == CFG) {
+      digitalWrite(PIN_SET_LED, HIGH);
+      set_chamber_config(instruction.target);
+      // Reply, followed by the new configuration and its variables
+      intervention_flag = true;
+      send_string(String("OK,CFG," + instruction.target));
+      send_chamber_config();
+      digitalWrite(PIN_SET_LED, LOW);
 
       /* RESET INSTRUCTION */
     } else if (instruction.type == RST) {
       digitalWrite(PIN_SET_LED, HIGH);
       digitalWrite(PIN_MSR_LED, HIGH);
       set_angle(&motor, 0);
+      wait_motor(&motor);
       detachInterrupt(digitalPinToInterrupt(PIN_FAN_IN_TACH));
       detachInterrupt(digitalPinToInterrupt(PIN_FAN_OUT_TACH));
       Timer1.detachInterrupt();
+      set_barometer_mode(BARO_SINGLE); // Stop background sampling
       send_string(String("OK,RST"));
       resetFunc();
     
@@ -1383,7 +2283,8 @@ void loop() {
 }
 
 // Interrupt function to perodically output white noise on the
-// PIN_NOISE pin
+// PIN_NOISE pin, and to time the fan RPM controllers
 void interrupt() {
   output_noise();
+  tick_fan_control();
 }
@@ -78,6 +78,8 @@ class Board:
         self.last_observation = np.single(
             -1
         )  # To keep track of observations send by the board
+        # Whether there are SETs the board has not applied yet, see commit
+        self.pending_commit = False
 
         # Wrap log function to filter by verbosity
         def log(string, verbosity_level=1, **kwargs):
@@ -106,7 +108,15 @@ class Board:
         self.serial.setDTR(False)
         self.serial.setDTR(True)
         self.log("Waiting for chamber to come online")
+        self.receive_config()
+        for i, var in enumerate(self.variables):
+            log(f"  {i-2} : {var}")
+
+    def receive_config(self):
+        """Receive the chamber configuration and its variables, as sent
+        by the board on start-up and after a CFG instruction.
 
+        """
         # Receive chamber configuration identifier
         while True:
             try:
@@ -134,8 +144,6 @@ class Board:
         self.n_bytes = len(response.variables) * 4
         # Add variables computed in this machine, i.e. the timestamp and config
         self.variables = ["timestamp", "config"] + response.variables
-        for i, var in enumerate(self.variables):
-            log(f"  {i-2} : {var}")
 
     def execute_instruction(self, instruction):
         """Execute an instruction, i.e. wait, set a variable, take
@@ -144,15 +152,23 @@ class Board:
         """
         self.log(f"\nExecuting instruction {instruction}")
         if instruction.kind == "WAIT_INPUT":
+            self.commit()
             input(instruction.prompt)
         elif instruction.kind == "WAIT":
+            self.commit()
             seconds = instruction.wait / 1000
             self.log("  waiting for %0.4f seconds" % seconds)
             time.sleep(seconds)
         elif instruction.kind == "SET":
             self.set_variable(instruction)
+        elif instruction.kind == "SETM":
+            self.set_variables(instruction)
+        elif instruction.kind == "COMMIT":
+            self.commit(force=True)
         elif instruction.kind == "MSR":
             return self.take_measurements(instruction)
+        elif instruction.kind == "CFG":
+            self.configure(instruction)
         elif instruction.kind == "RST":
             self.reset()  # TODO: maybe this resets the current object?
 
@@ -163,6 +179,47 @@ class Board:
         response = messages.parse(self.comms.receive())
         if response.kind != "OK":
             raise Exception(f"Unexpected response from board: {response}")
+        self.pending_commit = True
+
+    def set_variables(self, instruction):
+        if instruction.kind != "SETM":
+            raise ValueError(f'Wrong instruction type "{instruction}".')
+        self.comms.send(str(instruction))
+        response = messages.parse(self.comms.receive())
+        if response.kind != "OK":
+            raise Exception(f"Unexpected response from board: {response}")
+        # The board applies all pending changes at the end of a SETM
+        self.pending_commit = False
+
+    def commit(self, force=False):
+        """Make the board apply the changes of previous SETs that it
+        defers until a commit (e.g. the light-source color in the light
+        tunnel), so they take effect before waiting. An MSR also
+        commits them on the board.
+
+        """
+        if not (self.pending_commit or force):
+            return
+        self.comms.send("COMMIT")
+        response = messages.parse(self.comms.receive())
+        if response.kind != "OK":
+            raise Exception(f"Unexpected response from board: {response}")
+        self.pending_commit = False
+
+    def configure(self, instruction):
+        if instruction.kind != "CFG":
+            raise ValueError(f'Wrong instruction type "{instruction}".')
+        variables = self.variables
+        self.comms.send(f"CFG,{instruction.config}")
+        response = messages.parse(self.comms.receive())
+        if response.kind != "OK":
+            raise Exception(f"Unexpected response from board: {response}")
+        self.receive_config()
+        # The header of the output file is only written once
+        if self.variables != variables:
+            raise Exception(
+                f'Configuration "{self.chamber_config}" changed the board variables.'
+            )
 
     def reset(self):
         self.comms.send("RST")
@@ -174,19 +231,23 @@ class Board:
         if instruction.kind != "MSR":
             raise ValueError(f'Wrong instruction type "{instruction}".')
 
-        # Send MSR instruction
+        # Send MSR instruction (the board commits any pending changes)
         self.comms.send(f"MSR,{instruction.n},{instruction.wait}")
+        self.pending_commit = False
         # Receive and check confirmation
         response = messages.parse(self.comms.receive())
         if response.kind != "OK" or response.args[0] != "MSR":
             raise Exception(f"Unexpected response from board: {response}")
+        # The board replies with the number of observations it will
+        # send, e.g. several per measurement in camera bursts
+        n = int(response.args[1].split("=")[1])
 
         # Initialize buffer
-        observations = np.zeros((instruction.n, len(self.variables)), dtype=object)
+        observations = np.zeros((n, len(self.variables)), dtype=object)
 
         # Reception loop
         count = 0
-        while count < instruction.n:
+        while count < n:
             # Await response
             data_bytes = self.comms.receive()
             if len(data_bytes) != self.n_bytes:
@@ -216,7 +277,7 @@ class Board:
                 print(string, file=self.output_file)
                 self.output_file.flush()
             count += 1
-            self.log(f"  received observation {count}/{instruction.n}       ", end="\r")
+            self.log(f"  received observation {count}/{n}       ", end="\r")
         # Await for board to confirm that all observations were sent with <OK,DONE>
         response = messages.parse(self.comms.receive())
         if response.kind == "OK" and response.args[0] == "DONE":
@@ -48,7 +48,8 @@ class Message:
 
 
 # ----------------------------------------------------------------------
-# Experiment protocol instructions: SET, MSR, WAIT and WAIT_INPUT
+# Experiment protocol instructions: SET, SETM, COMMIT, MSR, CFG, WAIT
+# and WAIT_INPUT
 
 
 class SET(Message):
@@ -75,6 +76,47 @@ class SET(Message):
         self.value = self.args[1]
 
 
+class SETM(Message):
+    """
+    Examples
+    --------
+    >>> msg = SETM("SETM,red,255,green,0,blue,12.5")
+    >>> msg
+    <__main__.SETM object at ...>
+    >>> msg.targets
+    ['red', 'green', 'blue']
+    >>> msg.values
+    ['255', '0', '12.5']
+    >>> SETM("SETM,red,255,green")
+    Traceback (most recent call last):
+    ...
+    ValueError: Unrecognized message string "SETM,red,255,green"
+    """
+
+    def __init__(self, string):
+        regexp = re.compile("^SETM(,[a-z0-9_]+,-?\d*\.?\d*)+$")
+        super().__init__(string, regexp)
+        self.targets = self.args[0::2]
+        self.values = self.args[1::2]
+
+
+class COMMIT(Message):
+    """
+    Examples
+    --------
+    >>> COMMIT("COMMIT")
+    <__main__.COMMIT object at ...>
+    >>> COMMIT("COMMIT,1")
+    Traceback (most recent call last):
+    ...
+    ValueError: Unrecognized message string "COMMIT,1"
+    """
+
+    def __init__(self, string):
+        regexp = re.compile("^COMMIT$")
+        super().__init__(string, regexp)
+
+
 class MSR(Message):
     """
     Examples
@@ -99,6 +141,27 @@ class MSR(Message):
         self.wait = int(self.args[1])
 
 
+class CFG(Message):
+    """
+    Examples
+    --------
+    >>> msg = CFG("CFG,pressure-control")
+    >>> msg
+    <__main__.CFG object at ...>
+    >>> msg.config
+    'pressure-control'
+    >>> CFG("CFG,standard,1")
+    Traceback (most recent call last):
+    ...
+    ValueError: Unrecognized message string "CFG,standard,1"
+    """
+
+    def __init__(self, string):
+        regexp = re.compile("^CFG,[a-zA-Z0-9\-]+$")
+        super().__init__(string, regexp)
+        self.config = self.args[0]
+
+
 class WAIT(Message):
     """
     Examples
@@ -254,7 +317,7 @@ class CHAMBER_CONFIG(Message):
 # ----------------------------------------------------------------------
 # Parsing function
 
-INSTRUCTIONS = [SET, MSR, WAIT, WAIT_INPUT]
+INSTRUCTIONS = [SET, SETM, COMMIT, MSR, CFG, WAIT, WAIT_INPUT]
 RESPONSES = [OK, VARIABLES_LIST, CHAMBER_CONFIG]  # DATA]
 
 
@@ -266,8 +329,14 @@ def parse(string, accepted=INSTRUCTIONS + RESPONSES):
     --------
     >>> parse("SET,red,255")
     <__main__.SET object at ...>
+    >>> parse("SETM,red,255,blue,0")
+    <__main__.SETM object at ...>
+    >>> parse("COMMIT")
+    <__main__.COMMIT object at ...>
     >>> MSR("MSR,100,10")
     <__main__.MSR object at ...>
+    >>> parse("CFG,standard")
+    <__main__.CFG object at ...>
     >>> parse("WAIT,100")
     <__main__.WAIT object at ...>
     >>> parse("WAIT_INPUT,test")
@@ -46,6 +46,12 @@ def load(filename, targets):
                     raise SyntaxError(
                         f'Line {i}: target "{instruction.target}" does not match any variables on board'
                     )
+                if instruction.kind == "SETM":
+                    for target in instruction.targets:
+                        if target not in targets:
+                            raise SyntaxError(
+                                f'Line {i}: target "{target}" does not match any variables on board'
+                            )
                 parsed.append(instruction)
             except ValueError as e:
                 raise ValueError(
@@ -32,7 +32,7 @@ the OSI Model (pySerial would be the data link layer)"""
 
 START_SYMBOL = b"\0"
 END_SYMBOL = b"\4"
-ARDUINO_BUFFER_SIZE = 64
+ARDUINO_BUFFER_SIZE = 128
 
 WRITE_TIMEOUT = 0.1  # 100 milliseconds
 